@@ -0,0 +1,68 @@
+/**
+ *
+ *  BenchmarkUtil.h
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+namespace server::benchmarks
+{
+struct Measurement
+{
+    double p50_ns;
+    double p99_ns;
+    double mean_ns;
+};
+
+// q-quantile of already sorted samples, 0 when there are none.
+inline double Percentile(const std::vector<double> &sorted_samples, const double q)
+{
+    if (sorted_samples.empty())
+    {
+        return 0;
+    }
+    const auto index = static_cast<std::size_t>(q * static_cast<double>(sorted_samples.size()));
+    return sorted_samples[std::min(index, sorted_samples.size() - 1)];
+}
+
+// Runs fn `repetitions` times after a short warm-up and reports per-run latency percentiles.
+template <typename Fn> Measurement Measure(const std::size_t repetitions, Fn &&fn)
+{
+    for (std::size_t i = 0; i < std::max<std::size_t>(repetitions / 10, 1); ++i)
+    {
+        fn();
+    }
+
+    std::vector<double> samples;
+    samples.reserve(repetitions);
+    for (std::size_t i = 0; i < repetitions; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    std::ranges::sort(samples);
+
+    double total = 0;
+    for (const auto sample : samples)
+    {
+        total += sample;
+    }
+    return {Percentile(samples, 0.50), Percentile(samples, 0.99), total / samples.size()};
+}
+
+inline void Report(const std::string_view name, const Measurement &measurement, const std::size_t items = 1)
+{
+    std::cout << std::format("{:<48} p50 {:>12.0f} ns  p99 {:>12.0f} ns  mean/item {:>10.1f} ns\n", name,
+                             measurement.p50_ns, measurement.p99_ns, measurement.mean_ns / items);
+}
+} // namespace server::benchmarks
@@ -0,0 +1,502 @@
+/**
+ *
+ *  ChatLoadGenerator.cc
+ *
+ *  Load generator for /ws/chat. Seeds users, rooms and memberships straight into Postgres, mints access tokens
+ *  with the server's JwtTokenManager and registers them in Redis, then opens authenticated WebSocket clients against
+ *  a running server, drives chat traffic and reports connect rate, delivery latency and server RSS.
+ *
+ *  Usage: ChatLoadGenerator <server config.json> [--clients N] [--room-size N] [--hot-room] [--threads N]
+ *                           [--rate messages/s per room] [--duration s] [--host H] [--port P] [--server-pid PID]
+ *
+ *  Topology: clients are split into rooms of --room-size members; --hot-room additionally puts every client into
+ *  one shared room. The first member of every room sends --rate messages per second to it. The generator must run
+ *  on the server's host for delivery latency to be meaningful, and `ulimit -n` must allow the client count.
+ *
+ */
+
+#include "BenchmarkUtil.h"
+#include "models/User.h"
+#include "plugins/JwtTokenManager.h"
+
+#include <charconv>
+#include <drogon/WebSocketClient.h>
+#include <drogon/nosql/RedisClient.h>
+#include <drogon/orm/DbClient.h>
+#include <fstream>
+#include <json/json.h>
+#include <latch>
+#include <thread>
+#include <trantor/net/EventLoopThreadPool.h>
+
+using namespace drogon;
+using namespace server::benchmarks;
+
+namespace
+{
+constexpr std::string_view kUserPrefix{"loadgen_"};
+constexpr std::string_view kLatencyMarker{"lg:"};
+constexpr std::size_t kConnectBatchSize{500};
+constexpr std::chrono::seconds kSettleTime{2};
+constexpr std::chrono::seconds kDrainTime{2};
+
+struct Options
+{
+    std::string server_config;
+    std::size_t clients{1000};
+    std::size_t room_size{50};
+    bool hot_room{false};
+    std::size_t threads{std::max(std::thread::hardware_concurrency(), 1u)};
+    double rate{1.0};
+    std::chrono::seconds duration{30};
+    std::string host{"127.0.0.1"};
+    uint16_t port{0};
+    std::optional<int> server_pid;
+};
+
+struct Room
+{
+    int32_t id;
+    std::vector<std::size_t> members;
+};
+
+struct LoopStats
+{
+    std::mutex mutex;
+    std::vector<double> latencies_us;
+    uint64_t received{0};
+};
+
+struct Client
+{
+    int32_t user_id;
+    std::string access_token;
+    std::size_t loop_index;
+    WebSocketClientPtr ws;
+    std::atomic<bool> connected{false};
+};
+
+std::optional<Options> ParseOptions(const int argc, const char *argv[])
+{
+    if (argc < 2)
+    {
+        return std::nullopt;
+    }
+    Options options;
+    options.server_config = argv[1];
+    for (int i = 2; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--hot-room")
+        {
+            options.hot_room = true;
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            return std::nullopt;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--clients")
+        {
+            options.clients = std::stoul(value);
+        }
+        else if (arg == "--room-size")
+        {
+            options.room_size = std::max<std::size_t>(std::stoul(value), 1);
+        }
+        else if (arg == "--threads")
+        {
+            options.threads = std::max<std::size_t>(std::stoul(value), 1);
+        }
+        else if (arg == "--rate")
+        {
+            options.rate = std::stod(value);
+        }
+        else if (arg == "--duration")
+        {
+            options.duration = std::chrono::seconds{std::stoul(value)};
+        }
+        else if (arg == "--host")
+        {
+            options.host = value;
+        }
+        else if (arg == "--port")
+        {
+            options.port = static_cast<uint16_t>(std::stoul(value));
+        }
+        else if (arg == "--server-pid")
+        {
+            options.server_pid = std::stoi(value);
+        }
+        else
+        {
+            return std::nullopt;
+        }
+    }
+    return options;
+}
+
+std::expected<Json::Value, std::string> LoadJson(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return std::unexpected(std::format("Cannot open {}", path));
+    }
+    Json::CharReaderBuilder reader;
+    Json::Value json;
+    if (std::string errs; !Json::parseFromStream(reader, file, &json, &errs))
+    {
+        return std::unexpected(std::move(errs));
+    }
+    return json;
+}
+
+std::optional<std::size_t> ReadRssKb(const std::optional<int> pid)
+{
+    if (!pid)
+    {
+        return std::nullopt;
+    }
+    std::ifstream status(std::format("/proc/{}/status", *pid));
+    for (std::string line; std::getline(status, line);)
+    {
+        if (line.starts_with("VmRSS:"))
+        {
+            return std::stoul(line.substr(6));
+        }
+    }
+    return std::nullopt;
+}
+
+std::string PgIntArray(const std::span<const int32_t> values)
+{
+    std::string array = "{";
+    for (const auto value : values)
+    {
+        array.append(std::to_string(value)).push_back(',');
+    }
+    if (array.size() > 1)
+    {
+        array.pop_back();
+    }
+    return array + "}";
+}
+
+std::vector<int32_t> SeedUsers(const orm::DbClientPtr &db, const std::size_t count)
+{
+    const auto prefix = std::string(kUserPrefix);
+    const auto clients = static_cast<int32_t>(count);
+    db->execSqlSync(R"(INSERT INTO "user" (username, password)
+                       SELECT $1::text || g, '!' FROM generate_series(1, $2) g ON CONFLICT (username) DO NOTHING)",
+                    prefix, clients);
+    const auto rows = db->execSqlSync(R"(SELECT u.id FROM generate_series(1, $2) g
+                                         JOIN "user" u ON u.username = $1::text || g ORDER BY g)",
+                                      prefix, clients);
+    std::vector<int32_t> user_ids;
+    user_ids.reserve(rows.size());
+    for (const auto &row : rows)
+    {
+        user_ids.push_back(row["id"].as<int32_t>());
+    }
+    // Memberships of earlier runs would otherwise be loaded, and delivered to, as well.
+    db->execSqlSync(
+        "UPDATE room_membership SET deleted_at = now() WHERE deleted_at IS NULL AND user_id = ANY($1::int[])",
+        PgIntArray(user_ids));
+    return user_ids;
+}
+
+std::vector<Room> SeedRooms(const orm::DbClientPtr &db, const Options &options, const std::span<const int32_t> users)
+{
+    std::vector<Room> rooms;
+    for (std::size_t first = 0; first < users.size(); first += options.room_size)
+    {
+        Room room{0, {}};
+        for (auto member = first; member < std::min(first + options.room_size, users.size()); ++member)
+        {
+            room.members.push_back(member);
+        }
+        rooms.push_back(std::move(room));
+    }
+    if (options.hot_room)
+    {
+        Room room{0, {}};
+        for (std::size_t member = 0; member < users.size(); ++member)
+        {
+            room.members.push_back(member);
+        }
+        rooms.push_back(std::move(room));
+    }
+
+    const auto room_rows = db->execSqlSync(
+        "INSERT INTO room (name) SELECT $1::text || g FROM generate_series(1, $2) g RETURNING id",
+        std::string(kUserPrefix), static_cast<int32_t>(rooms.size()));
+    std::vector<int32_t> membership_users;
+    std::vector<int32_t> membership_rooms;
+    for (std::size_t i = 0; i < rooms.size(); ++i)
+    {
+        rooms[i].id = room_rows[i]["id"].as<int32_t>();
+        for (const auto member : rooms[i].members)
+        {
+            membership_users.push_back(users[member]);
+            membership_rooms.push_back(rooms[i].id);
+        }
+    }
+    db->execSqlSync("INSERT INTO room_membership (user_id, room_id) SELECT * FROM unnest($1::int[], $2::int[])",
+                    PgIntArray(membership_users), PgIntArray(membership_rooms));
+    return rooms;
+}
+
+// Mints one refresh/access token pair per user and registers it the way RedisManager::StoreRefreshTokenId does.
+void IssueTokens(const JwtTokenManager &token_manager, const nosql::RedisClientPtr &redis,
+                 std::vector<std::unique_ptr<Client>> &clients)
+{
+    for (auto &client : clients)
+    {
+        drogon_model::postgres::User user;
+        user.setId(client->user_id);
+        user.setUsername(std::format("{}{}", kUserPrefix, client->user_id));
+        user.setRole("user");
+        const auto refresh = token_manager.GenerateRefreshToken(user).context;
+        auto access = token_manager.GenerateAccessToken(refresh, user);
+        client->access_token = std::move(access.token);
+
+        redis->execCommandSync<std::string>(
+            [](const nosql::RedisResult &result) { return result.asString(); }, "SET refresh_token:%d:%s %s EXAT %lld",
+            static_cast<int>(refresh.user_id), refresh.token_id.c_str(), access.context.token_id.c_str(),
+            static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(
+                                       refresh.expires_at.time_since_epoch())
+                                       .count()));
+    }
+}
+
+int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Chat events echo the content back; the sender's timestamp is parsed without decoding the whole event.
+std::optional<int64_t> ParseSentAt(const std::string_view message)
+{
+    const auto marker = message.find(kLatencyMarker);
+    if (marker == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    int64_t sent_at{};
+    const auto begin = message.data() + marker + kLatencyMarker.size();
+    if (std::from_chars(begin, message.data() + message.size(), sent_at).ec != std::errc{})
+    {
+        return std::nullopt;
+    }
+    return sent_at;
+}
+
+void ReportRss(const std::string_view phase, const Options &options)
+{
+    if (const auto rss_kb = ReadRssKb(options.server_pid))
+    {
+        std::cout << std::format("server RSS {:<20} {:>10} KiB\n", phase, *rss_kb);
+    }
+}
+} // namespace
+
+int main(const int argc, const char *argv[])
+{
+    const auto options_opt = ParseOptions(argc, argv);
+    if (!options_opt)
+    {
+        std::cerr << "Usage: ChatLoadGenerator <server config.json> [--clients N] [--room-size N] [--hot-room] "
+                     "[--threads N] [--rate messages/s per room] [--duration s] [--host H] [--port P] "
+                     "[--server-pid PID]\n";
+        return 1;
+    }
+    auto options = *options_opt;
+    const auto config = LoadJson(options.server_config);
+    if (!config)
+    {
+        std::cerr << config.error() << '\n';
+        return 1;
+    }
+    if (options.port == 0)
+    {
+        options.port = static_cast<uint16_t>((*config)["listeners"][0].get("port", 80).asUInt());
+    }
+
+    const auto &db_config = (*config)["db_clients"][0];
+    const auto db = orm::DbClient::newPgClient(
+        std::format("host={} port={} dbname={} user={} password={}", db_config.get("host", "127.0.0.1").asString(),
+                    db_config.get("port", 5432).asUInt(), db_config.get("dbname", "postgres").asString(),
+                    db_config.get("user", "postgres").asString(), db_config.get("passwd", "").asString()),
+        1);
+    const auto &redis_config = (*config)["redis_clients"][0];
+    const auto redis = nosql::RedisClient::newRedisClient(
+        trantor::InetAddress(redis_config.get("host", "127.0.0.1").asString(),
+                             static_cast<uint16_t>(redis_config.get("port", 6379).asUInt())),
+        1, redis_config.get("passwd", "").asString(), redis_config.get("db", 0).asUInt());
+
+    JwtTokenManager token_manager;
+    for (const auto &plugin : (*config)["plugins"])
+    {
+        if (plugin["name"].asString() == "JwtTokenManager")
+        {
+            token_manager.initAndStart(plugin["config"]);
+        }
+    }
+
+    std::vector<Room> rooms;
+    std::vector<std::unique_ptr<Client>> clients;
+    try
+    {
+        const auto user_ids = SeedUsers(db, options.clients);
+        rooms = SeedRooms(db, options, user_ids);
+        for (std::size_t i = 0; i < user_ids.size(); ++i)
+        {
+            auto client = std::make_unique<Client>();
+            client->user_id = user_ids[i];
+            client->loop_index = i % options.threads;
+            clients.push_back(std::move(client));
+        }
+        IssueTokens(token_manager, redis, clients);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Seeding failed: " << e.what() << '\n';
+        return 1;
+    }
+    std::cout << std::format("seeded {} clients in {} rooms\n", clients.size(), rooms.size());
+    ReportRss("before connect", options);
+
+    trantor::EventLoopThreadPool loop_pool(options.threads, "ChatLoadGenerator");
+    loop_pool.start();
+    std::vector<LoopStats> loop_stats(options.threads);
+    const auto server_url = std::format("ws://{}:{}", options.host, options.port);
+
+    std::vector<double> connect_latencies_us;
+    std::mutex connect_mutex;
+    const auto connect_start = std::chrono::steady_clock::now();
+    for (std::size_t first = 0; first < clients.size(); first += kConnectBatchSize)
+    {
+        const auto last = std::min(first + kConnectBatchSize, clients.size());
+        std::latch batch_done(static_cast<std::ptrdiff_t>(last - first));
+        for (auto i = first; i < last; ++i)
+        {
+            auto &client = *clients[i];
+            auto &stats = loop_stats[client.loop_index];
+            client.ws = WebSocketClient::newWebSocketClient(server_url, loop_pool.getLoop(client.loop_index));
+            client.ws->setMessageHandler(
+                [&stats](std::string &&message, const WebSocketClientPtr &, const WebSocketMessageType &type) {
+                    if (type != WebSocketMessageType::Text)
+                    {
+                        return;
+                    }
+                    const auto sent_at = ParseSentAt(message);
+                    if (!sent_at)
+                    {
+                        return;
+                    }
+                    const auto latency_us = static_cast<double>(NowNs() - *sent_at) / 1000.0;
+                    std::lock_guard lock(stats.mutex);
+                    stats.latencies_us.push_back(latency_us);
+                    ++stats.received;
+                });
+
+            const auto req = HttpRequest::newHttpRequest();
+            req->setPath("/ws/chat");
+            req->addHeader("Authorization", "Bearer " + client.access_token);
+            const auto started_at = NowNs();
+            client.ws->connectToServer(req, [&, started_at](const ReqResult result, const HttpResponsePtr &,
+                                                            const WebSocketClientPtr &) {
+                if (result == ReqResult::Ok)
+                {
+                    client.connected = true;
+                    std::lock_guard lock(connect_mutex);
+                    connect_latencies_us.push_back(static_cast<double>(NowNs() - started_at) / 1000.0);
+                }
+                batch_done.count_down();
+            });
+        }
+        batch_done.wait();
+    }
+    const std::chrono::duration<double> connect_elapsed = std::chrono::steady_clock::now() - connect_start;
+
+    std::ranges::sort(connect_latencies_us);
+    const auto connected = connect_latencies_us.size();
+    std::cout << std::format("connected {}/{} in {:.2f} s: {:.0f} connects/s, connect p50 {:.0f} us p99 {:.0f} us\n",
+                             connected, clients.size(), connect_elapsed.count(),
+                             static_cast<double>(connected) / connect_elapsed.count(),
+                             Percentile(connect_latencies_us, 0.50), Percentile(connect_latencies_us, 0.99));
+    ReportRss("after connect", options);
+
+    // Memberships are loaded asynchronously after the upgrade.
+    std::this_thread::sleep_for(kSettleTime);
+
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> expected_deliveries{0};
+    std::vector<std::pair<trantor::EventLoop *, trantor::TimerId>> timers;
+    for (const auto &room : rooms)
+    {
+        auto &sender = *clients[room.members.front()];
+        if (!sender.connected || options.rate <= 0)
+        {
+            continue;
+        }
+        const auto connected_members = static_cast<uint64_t>(
+            std::ranges::count_if(room.members, [&clients](const auto member) { return clients[member]->connected; }));
+        auto *const loop = loop_pool.getLoop(sender.loop_index);
+        const auto timer_id = loop->runEvery(1.0 / options.rate, [&sender, &sent, &expected_deliveries,
+                                                                  room_id = room.id, connected_members] {
+            const auto connection = sender.ws->getConnection();
+            if (!connection || !connection->connected())
+            {
+                return;
+            }
+            Json::Value request;
+            request["type"] = "message";
+            request["room_id"] = room_id;
+            request["content"] = std::format("{}{}", kLatencyMarker, NowNs());
+            connection->sendJson(request);
+            sent.fetch_add(1, std::memory_order_relaxed);
+            expected_deliveries.fetch_add(connected_members, std::memory_order_relaxed);
+        });
+        timers.emplace_back(loop, timer_id);
+    }
+
+    std::this_thread::sleep_for(options.duration);
+    for (const auto &[loop, timer_id] : timers)
+    {
+        loop->invalidateTimer(timer_id);
+    }
+    std::this_thread::sleep_for(kDrainTime);
+    ReportRss("after traffic", options);
+
+    std::vector<double> latencies_us;
+    uint64_t received{0};
+    for (auto &stats : loop_stats)
+    {
+        std::lock_guard lock(stats.mutex);
+        latencies_us.insert(latencies_us.end(), stats.latencies_us.begin(), stats.latencies_us.end());
+        received += stats.received;
+    }
+    std::ranges::sort(latencies_us);
+    std::cout << std::format("sent {} messages, delivered {}/{} ({:.0f} deliveries/s)\n", sent.load(), received,
+                             expected_deliveries.load(), static_cast<double>(received) / options.duration.count());
+    std::cout << std::format("delivery latency p50 {:.0f} us  p99 {:.0f} us  p999 {:.0f} us  max {:.0f} us\n",
+                             Percentile(latencies_us, 0.50), Percentile(latencies_us, 0.99),
+                             Percentile(latencies_us, 0.999), latencies_us.empty() ? 0.0 : latencies_us.back());
+
+    for (const auto &client : clients)
+    {
+        if (client->ws)
+        {
+            client->ws->stop();
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    loop_pool.stop();
+    loop_pool.wait();
+    return 0;
+}
@@ -0,0 +1,64 @@
+/**
+ *
+ *  CodecBenchmark.cc
+ *
+ *  Encode/decode cost and frame size of a chat event in the MessagePack framing versus the jsoncpp text path.
+ *
+ */
+
+#include "BenchmarkUtil.h"
+#include "realtime/MsgPackCodec.h"
+
+#include <json/json.h>
+#include <memory>
+
+using namespace server::benchmarks;
+
+namespace
+{
+Json::Value MakeEvent(const std::size_t content_size)
+{
+    Json::Value event;
+    event["type"] = "message";
+    event["message"]["id"] = 123456;
+    event["message"]["room_id"] = 42;
+    event["message"]["user_id"] = 1337;
+    event["message"]["content"] = std::string(content_size, 'x');
+    event["message"]["created_at"] = "2024-01-01 00:00:00";
+    event["message"]["deleted_at"] = Json::nullValue;
+    return event;
+}
+} // namespace
+
+int main()
+{
+    Json::StreamWriterBuilder writer_builder;
+    writer_builder["indentation"] = "";
+    const Json::CharReaderBuilder reader_builder;
+    const std::unique_ptr<Json::CharReader> reader(reader_builder.newCharReader());
+
+    for (const std::size_t content_size : {16, 256, 4096})
+    {
+        const auto event = MakeEvent(content_size);
+        const auto json_text = Json::writeString(writer_builder, event);
+        const auto msgpack = server::realtime::EncodeMsgPack(event);
+        std::cout << std::format("content {:>5} B: json frame {:>5} B, msgpack frame {:>5} B\n", content_size,
+                                 json_text.size(), msgpack.size());
+
+        Report(std::format("jsoncpp encode / {}", content_size), Measure(100'000, [&] {
+                   [[maybe_unused]] volatile auto size = Json::writeString(writer_builder, event).size();
+               }));
+        Report(std::format("msgpack encode / {}", content_size), Measure(100'000, [&] {
+                   [[maybe_unused]] volatile auto size = server::realtime::EncodeMsgPack(event).size();
+               }));
+        Report(std::format("jsoncpp decode / {}", content_size), Measure(100'000, [&] {
+                   Json::Value decoded;
+                   std::string errs;
+                   reader->parse(json_text.data(), json_text.data() + json_text.size(), &decoded, &errs);
+               }));
+        Report(std::format("msgpack decode / {}", content_size), Measure(100'000, [&] {
+                   [[maybe_unused]] volatile auto ok = server::realtime::DecodeMsgPack(msgpack).has_value();
+               }));
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ *
+ *  FanoutBenchmark.cc
+ *
+ *  Fan-out latency of one chat event to 10..10k recipients, and the bytes copied per broadcast: building the JSON and
+ *  looking up the connection map for every recipient, the room index with a single serialization but a frame built
+ *  per recipient (what WebSocketConnection::send does), and the room index with one frame shared by every recipient.
+ *
+ */
+
+#include "BenchmarkUtil.h"
+#include "realtime/RoomIndex.h"
+#include "realtime/WebSocketFrame.h"
+
+#include <json/json.h>
+#include <memory>
+#include <unordered_map>
+
+using namespace server::benchmarks;
+
+namespace
+{
+// Spreads members over as many owners as a typical IO thread count.
+constexpr std::size_t kOwnerCount{8};
+
+std::size_t bytes_copied{0};
+
+struct FakeConnection
+{
+    // Frames the payload itself, like WebSocketConnection::send.
+    void send(const std::string &payload)
+    {
+        const auto frame = server::realtime::MakeServerFrame(payload, false);
+        bytes_copied += frame->size();
+        bytes_sent += frame->size();
+    }
+
+    // Takes a reference on a prebuilt frame, like TcpConnection::send(std::shared_ptr<std::string>).
+    void send(const std::shared_ptr<std::string> &frame)
+    {
+        last_frame = frame;
+        bytes_sent += frame->size();
+    }
+
+    std::size_t bytes_sent{0};
+    std::shared_ptr<std::string> last_frame;
+};
+using FakeConnectionPtr = std::shared_ptr<FakeConnection>;
+
+Json::Value MakeEvent()
+{
+    Json::Value event;
+    event["type"] = "message";
+    event["message"]["id"] = 123456;
+    event["message"]["room_id"] = 1;
+    event["message"]["user_id"] = 42;
+    event["message"]["content"] = std::string(200, 'x');
+    event["message"]["created_at"] = "2024-01-01 00:00:00";
+    return event;
+}
+
+std::string Serialize(const Json::Value &event);
+
+// Bytes serialized or copied by one run of fn.
+template <typename Fn> std::size_t BytesCopied(Fn &&fn)
+{
+    bytes_copied = 0;
+    fn();
+    return bytes_copied;
+}
+
+const Json::StreamWriterBuilder &Writer()
+{
+    static const auto writer_builder = [] {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return builder;
+    }();
+    return writer_builder;
+}
+std::string Serialize(const Json::Value &event)
+{
+    auto payload = Json::writeString(Writer(), event);
+    bytes_copied += payload.size();
+    return payload;
+}
+} // namespace
+
+int main()
+{
+    const auto event = MakeEvent();
+    for (const std::size_t recipients : {10, 100, 1'000, 10'000})
+    {
+        const auto repetitions = std::max<std::size_t>(100'000 / recipients, 50);
+
+        server::realtime::RoomIndex<int, std::size_t, FakeConnectionPtr> room_index;
+        std::unordered_map<int, FakeConnectionPtr> connections_by_user;
+        std::vector<int> member_user_ids;
+        for (std::size_t i = 0; i < recipients; ++i)
+        {
+            auto conn = std::make_shared<FakeConnection>();
+            room_index.Add(1, i % kOwnerCount, conn);
+            connections_by_user.emplace(static_cast<int>(i), conn);
+            member_user_ids.push_back(static_cast<int>(i));
+        }
+
+        const auto per_recipient_fn = [&] {
+            for (const auto user_id : member_user_ids)
+            {
+                if (const auto it = connections_by_user.find(user_id); it != connections_by_user.end())
+                {
+                    it->second->send(Serialize(event));
+                }
+            }
+        };
+        Report(std::format("per-recipient serialize+lookup / {}", recipients), Measure(repetitions, per_recipient_fn),
+               recipients);
+        std::cout << std::format("{:<48} {:>12} bytes copied/broadcast\n", "", BytesCopied(per_recipient_fn));
+
+        const auto serialize_once_fn = [&] {
+            const auto payload = Serialize(event);
+            room_index.ForEachMember(1, [&payload](const FakeConnectionPtr &conn) { conn->send(payload); });
+        };
+        Report(std::format("room index serialize-once / {}", recipients), Measure(repetitions, serialize_once_fn),
+               recipients);
+        std::cout << std::format("{:<48} {:>12} bytes copied/broadcast\n", "", BytesCopied(serialize_once_fn));
+
+        const auto shared_frame_fn = [&] {
+            const auto frame = server::realtime::MakeServerFrame(Serialize(event), false);
+            bytes_copied += frame->size();
+            room_index.ForEachMember(1, [&frame](const FakeConnectionPtr &conn) { conn->send(frame); });
+        };
+        Report(std::format("room index shared frame / {}", recipients), Measure(repetitions, shared_frame_fn),
+               recipients);
+        std::cout << std::format("{:<48} {:>12} bytes copied/broadcast\n", "", BytesCopied(shared_frame_fn));
+    }
+    return 0;
+}
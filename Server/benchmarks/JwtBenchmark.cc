@@ -0,0 +1,93 @@
+/**
+ *
+ *  JwtBenchmark.cc
+ *
+ *  ns/op of signing and verifying an access token the way JwtTokenManager used to (a jwt::algorithm::hs256 and a
+ *  verifier built on every call) versus the way it does now (a verifier built once, over HmacSha256 with precomputed
+ *  pad states). Before timing, tokens signed by either algorithm are checked to verify with the other, and a tampered
+ *  signature to be rejected by both.
+ *
+ */
+
+#include "BenchmarkUtil.h"
+#include "utilities/HmacSha256.h"
+
+using namespace server::benchmarks;
+using namespace server::utilities;
+
+namespace
+{
+constexpr std::size_t kRepetitions{100000};
+constexpr std::string_view kSecret{"benchmark-secret-of-a-realistic-length-0123456789"};
+constexpr std::string_view kIssuer{"server"};
+
+template <typename Algorithm> std::string Sign(const Algorithm &algorithm)
+{
+    return jwt::create()
+        .set_issuer(std::string(kIssuer))
+        .set_id("123e4567-e89b-12d3-a456-426614174000")
+        .set_subject("1337")
+        .set_payload_claim("refresh_id", jwt::claim(std::string("123e4567-e89b-42d3-8456-426614174001")))
+        .set_payload_claim("username", jwt::claim(std::string("benchmark_user")))
+        .set_payload_claim("role", jwt::claim(std::string("user")))
+        .set_type("access")
+        .set_expires_at(std::chrono::system_clock::now() + std::chrono::hours{1})
+        .sign(algorithm);
+}
+
+template <typename Algorithm> auto MakeVerifier(const Algorithm &algorithm)
+{
+    return jwt::verify().allow_algorithm(algorithm).with_issuer(std::string(kIssuer)).with_type("access");
+}
+
+template <typename Verifier> bool Verifies(const Verifier &verifier, const std::string &token)
+{
+    std::error_code ec;
+    verifier.verify(jwt::decode(token), ec);
+    return !ec;
+}
+
+bool CheckInteroperability(const jwt::algorithm::hs256 &reference, const HmacSha256 &precomputed)
+{
+    const auto reference_verifier = MakeVerifier(reference);
+    const auto precomputed_verifier = MakeVerifier(precomputed);
+    const auto reference_token = Sign(reference);
+    const auto precomputed_token = Sign(precomputed);
+    // The last base64url character of a 32-byte signature carries two padding bits that decoders ignore, so flip one
+    // in the middle, where every bit is part of the MAC.
+    auto tampered_token = precomputed_token;
+    const auto signature_begin = tampered_token.rfind('.') + 1;
+    auto &tampered = tampered_token[signature_begin + (tampered_token.size() - signature_begin) / 2];
+    tampered = tampered == 'A' ? 'B' : 'A';
+
+    const bool ok = Verifies(precomputed_verifier, reference_token) &&
+                    Verifies(reference_verifier, precomputed_token) &&
+                    !Verifies(reference_verifier, tampered_token) && !Verifies(precomputed_verifier, tampered_token);
+    std::cout << std::format("interoperability check {}\n", ok ? "passed" : "FAILED");
+    return ok;
+}
+} // namespace
+
+int main()
+{
+    const std::string secret(kSecret);
+    const HmacSha256 precomputed(secret);
+    if (!CheckInteroperability(jwt::algorithm::hs256{secret}, precomputed))
+    {
+        return 1;
+    }
+
+    std::size_t bytes = 0;
+    Report("sign, hs256 per call", Measure(kRepetitions, [&] { bytes += Sign(jwt::algorithm::hs256{secret}).size(); }));
+    Report("sign, precomputed HmacSha256", Measure(kRepetitions, [&] { bytes += Sign(precomputed).size(); }));
+
+    const auto token = Sign(precomputed);
+    std::size_t verified = 0;
+    Report("verify, verifier and hs256 per call",
+           Measure(kRepetitions, [&] { verified += Verifies(MakeVerifier(jwt::algorithm::hs256{secret}), token); }));
+    const auto verifier = MakeVerifier(precomputed);
+    Report("verify, prebuilt verifier", Measure(kRepetitions, [&] { verified += Verifies(verifier, token); }));
+
+    std::cout << std::format("({} bytes signed, {} tokens verified)\n", bytes, verified);
+    return 0;
+}
@@ -0,0 +1,59 @@
+/**
+ *
+ *  RedisCommandBenchmark.cc
+ *
+ *  Cost of encoding "SET user:<id> <value>" into the Redis protocol for 1 KB and 64 KB values: formatting the whole
+ *  command line and letting hiredis split it on spaces, versus passing every argument as a "%b" bulk string through
+ *  RedisCommand. Both paths end in redisFormatCommand, as drogon's execCommand* do.
+ *
+ */
+
+#include "BenchmarkUtil.h"
+#include "utilities/RedisCommand.h"
+
+#include <cstdlib>
+#include <hiredis/hiredis.h>
+
+using namespace server::benchmarks;
+using namespace server::utilities;
+
+namespace
+{
+constexpr std::size_t kRepetitions{20000};
+
+std::size_t protocol_bytes{0};
+
+void Consume(char *protocol, const int length)
+{
+    protocol_bytes += length;
+    std::free(protocol);
+}
+} // namespace
+
+int main()
+{
+    constexpr int kUserId = 1337;
+    for (const std::size_t value_size : {1024, 64 * 1024})
+    {
+        // No spaces, or the command line path would split the value into several arguments.
+        const std::string value(value_size, 'x');
+        std::cout << std::format("value of {} bytes\n", value_size);
+
+        Report("  std::format command line", Measure(kRepetitions, [&] {
+                   const auto command = std::format("SET user:{} {}", kUserId, value);
+                   char *protocol = nullptr;
+                   Consume(protocol, redisFormatCommand(&protocol, command.c_str()));
+               }));
+
+        Report("  RedisCommand %b arguments", Measure(kRepetitions, [&] {
+                   const auto key = std::format("user:{}", kUserId);
+                   const RedisCommand command("SET", key, value);
+                   char *protocol = nullptr;
+                   Consume(protocol, command.Apply([&protocol](const auto... argv) {
+                       return redisFormatCommand(&protocol, argv...);
+                   }));
+               }));
+    }
+    std::cout << std::format("({} protocol bytes produced)\n", protocol_bytes);
+    return 0;
+}
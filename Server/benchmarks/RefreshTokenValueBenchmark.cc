@@ -0,0 +1,107 @@
+/**
+ *
+ *  RefreshTokenValueBenchmark.cc
+ *
+ *  Cost of reading the value kept at refresh_token:<user>:<id>, which RevocationList parses on every rotation.
+ *  Before timing anything, random expiries (at system_clock precision, as NextAccessTokenExpiry produces them) are
+ *  written with AccessTokenValue, with and without a rotation's ";prev:" suffix, and read back with
+ *  ParseAccessTokenValue; the benchmark fails unless every one comes back truncated to the second.
+ *
+ */
+
+#include "BenchmarkUtil.h"
+#include "utilities/RefreshTokenValue.h"
+
+#include <random>
+
+using namespace server::benchmarks;
+using namespace server::utilities;
+
+namespace
+{
+constexpr std::size_t kRoundTrips{200000};
+constexpr std::size_t kRepetitions{200000};
+constexpr std::string_view kAccessTokenId{"123e4567-e89b-12d3-a456-426614174000"};
+
+std::chrono::system_clock::time_point RandomExpiry(std::mt19937_64 &rng)
+{
+    // 2000-01-01 to 2100-01-01, with a sub-second part.
+    constexpr std::chrono::seconds kFirst{946684800};
+    constexpr std::chrono::seconds kLast{4102444800};
+    const std::chrono::seconds seconds{kFirst.count() + static_cast<int64_t>(rng() % (kLast - kFirst).count())};
+    const std::chrono::nanoseconds fraction{rng() % 1000000000};
+    return std::chrono::system_clock::time_point{seconds} +
+           std::chrono::duration_cast<std::chrono::system_clock::duration>(fraction);
+}
+
+bool CheckRoundTrip()
+{
+    using std::chrono::floor;
+    using std::chrono::seconds;
+    std::mt19937_64 rng(42);
+    for (std::size_t i = 0; i < kRoundTrips; ++i)
+    {
+        const auto expires_at = RandomExpiry(rng);
+        const auto superseded_expires_at = RandomExpiry(rng);
+        const bool rotated = rng() % 2 == 0;
+        auto value = AccessTokenValue(kAccessTokenId, expires_at);
+        if (rotated)
+        {
+            // What the rotation script appends: the previous value's expiry field.
+            const auto previous = AccessTokenValue(kAccessTokenId, superseded_expires_at);
+            value += ";prev:" + previous.substr(previous.find(";exp:") + 5);
+        }
+        const auto state = ParseAccessTokenValue(value);
+        if (!state || state->access_token_id != kAccessTokenId ||
+            state->access_expires_at != floor<seconds>(expires_at) ||
+            state->superseded_expires_at.has_value() != rotated ||
+            (rotated && *state->superseded_expires_at != floor<seconds>(superseded_expires_at)))
+        {
+            std::cout << std::format("round trip failed for {:?}\n", value);
+            return false;
+        }
+    }
+
+    // Values written while expiries still carried a fractional part.
+    const auto legacy = ParseAccessTokenValue(std::format("{};exp:2026-10-18_04:14:39.123456789", kAccessTokenId));
+    if (!legacy || legacy->access_expires_at != std::chrono::sys_days{std::chrono::October / 18 / 2026} +
+                                                    std::chrono::hours{4} + std::chrono::minutes{14} + seconds{39})
+    {
+        std::cout << "legacy fractional expiry not read\n";
+        return false;
+    }
+    for (const auto malformed : {"2026-10-18_04:14:39.", "2026-10-18_04:14:39.5x", "2026-10-18_04:14:3",
+                                 "2026-13-18_04:14:39"})
+    {
+        if (ParseExpiry(malformed))
+        {
+            std::cout << std::format("accepted malformed expiry {:?}\n", malformed);
+            return false;
+        }
+    }
+    std::cout << std::format("{} round trips passed\n", kRoundTrips);
+    return true;
+}
+} // namespace
+
+int main()
+{
+    if (!CheckRoundTrip())
+    {
+        return 1;
+    }
+
+    const auto now = std::chrono::system_clock::now();
+    for (const auto &[name, value] :
+         {std::pair{"issued", AccessTokenValue(kAccessTokenId, now)},
+          std::pair{"rotated", AccessTokenValue(kAccessTokenId, now) + ";prev:2026-10-18_04:14:39"}})
+    {
+        // Read through a volatile pointer so that the parse cannot be hoisted out of the loop.
+        const std::string *volatile input = &value;
+        std::size_t parsed = 0;
+        Report(std::format("ParseAccessTokenValue ({})", name),
+               Measure(kRepetitions, [&] { parsed += ParseAccessTokenValue(*input).has_value(); }));
+        std::cout << std::format("  ({} parsed)\n", parsed);
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+/**
+ *
+ *  RegistryContentionBenchmark.cc
+ *
+ *  Reconnect-storm throughput of the sharded ConnectionRegistry against the previous design: one unordered_map
+ *  behind one shared_mutex, upgraded from shared to unique by unlocking and relocking. The second run also registers
+ *  every connection in its rooms, comparing the sharded RoomIndex with the same index behind a single lock.
+ *
+ */
+
+#include "realtime/ConnectionRegistry.h"
+#include "realtime/RoomIndex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct FakeConnection
+{
+};
+using FakeConnectionPtr = std::shared_ptr<FakeConnection>;
+
+class SingleLockRegistry
+{
+  public:
+    FakeConnectionPtr Insert(const int user_id, const std::string &refresh_token_id, FakeConnectionPtr conn)
+    {
+        {
+            std::shared_lock read_lock(mutex_);
+            if (auto it = connections_.find(user_id); it != connections_.end() && it->second.contains(refresh_token_id))
+            {
+                auto old_conn = it->second.at(refresh_token_id);
+                read_lock.unlock();
+                std::unique_lock write_lock(mutex_);
+                connections_[user_id][refresh_token_id] = std::move(conn);
+                return old_conn;
+            }
+        }
+        std::unique_lock write_lock(mutex_);
+        connections_[user_id][refresh_token_id] = std::move(conn);
+        return {};
+    }
+
+    bool Erase(const int user_id, const std::string &refresh_token_id, const FakeConnectionPtr &conn)
+    {
+        {
+            std::shared_lock read_lock(mutex_);
+            const auto it = connections_.find(user_id);
+            if (it == connections_.end() || !it->second.contains(refresh_token_id) ||
+                it->second.at(refresh_token_id) != conn)
+            {
+                return false;
+            }
+        }
+        // Other threads may have rehashed the outer map while no lock was held, so look the entry up again.
+        std::unique_lock write_lock(mutex_);
+        const auto it = connections_.find(user_id);
+        if (it == connections_.end())
+        {
+            return false;
+        }
+        const auto it2 = it->second.find(refresh_token_id);
+        if (it2 == it->second.end() || it2->second != conn)
+        {
+            return false;
+        }
+        it->second.erase(it2);
+        if (it->second.empty())
+        {
+            connections_.erase(it);
+        }
+        return true;
+    }
+
+  private:
+    std::shared_mutex mutex_;
+    std::unordered_map<int, std::unordered_map<std::string, FakeConnectionPtr>> connections_;
+};
+
+// Registry plus room index, driven the way ChatSocketController connects and disconnects a socket: the connection is
+// registered, then added to each of its rooms, and removed from them again on close. Rooms are shared across threads.
+template <typename Registry, typename Rooms> struct ChatConnections
+{
+    static constexpr int kRoomCount = 1000;
+    static constexpr int kRoomsPerUser = 5;
+
+    Registry registry;
+    Rooms rooms;
+
+    static int RoomOf(const int user_id, const int j)
+    {
+        return (user_id * 7 + j * 131) % kRoomCount;
+    }
+
+    void Connect(const int user_id, const std::string &refresh_token_id, const FakeConnectionPtr &conn,
+                 const std::size_t owner, const bool with_rooms)
+    {
+        registry.Insert(user_id, refresh_token_id, conn);
+        for (int j = 0; with_rooms && j < kRoomsPerUser; ++j)
+        {
+            rooms.Add(RoomOf(user_id, j), owner, conn);
+        }
+    }
+
+    void Disconnect(const int user_id, const std::string &refresh_token_id, const FakeConnectionPtr &conn,
+                    const bool with_rooms)
+    {
+        for (int j = 0; with_rooms && j < kRoomsPerUser; ++j)
+        {
+            rooms.Remove(RoomOf(user_id, j), conn);
+        }
+        registry.Erase(user_id, refresh_token_id, conn);
+    }
+};
+
+using LegacyConnections =
+    ChatConnections<SingleLockRegistry, server::realtime::RoomIndex<int, std::size_t, FakeConnectionPtr, 1>>;
+using ShardedConnections = ChatConnections<server::realtime::ConnectionRegistry<int, FakeConnectionPtr>,
+                                           server::realtime::RoomIndex<int, std::size_t, FakeConnectionPtr>>;
+
+// Each thread owns a disjoint slice of users, so no entry is touched by two threads between the legacy registry's
+// unlock and relock. The outer map is still shared, which is why SingleLockRegistry::Erase looks its entry up
+// again under the write lock instead of reusing iterators across the gap.
+template <typename Connections>
+double ReconnectsPerSecond(const std::size_t thread_count, const int users_per_thread, const bool with_rooms)
+{
+    Connections connections;
+    constexpr int kCycles = 4;
+    std::atomic<bool> start{false};
+    std::vector<std::jthread> threads;
+    for (std::size_t t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&, t] {
+            const int first_user = static_cast<int>(t) * users_per_thread;
+            // One connection per user: the room index tells members apart by connection.
+            std::vector<FakeConnectionPtr> conns(users_per_thread);
+            std::ranges::generate(conns, [] { return std::make_shared<FakeConnection>(); });
+            const std::string refresh_token_id = "8f14e45f-ceea-467f-a0e6-6f2a7c5b1d3e";
+            while (!start.load(std::memory_order_acquire))
+            {
+            }
+            for (int cycle = 0; cycle < kCycles; ++cycle)
+            {
+                for (int i = 0; i < users_per_thread; ++i)
+                {
+                    connections.Connect(first_user + i, refresh_token_id, conns[i], t, with_rooms);
+                }
+                for (int i = 0; i < users_per_thread; ++i)
+                {
+                    connections.Disconnect(first_user + i, refresh_token_id, conns[i], with_rooms);
+                }
+            }
+        });
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    threads.clear();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return static_cast<double>(thread_count) * users_per_thread * kCycles / elapsed;
+}
+} // namespace
+
+int main()
+{
+    constexpr int kSockets = 50'000;
+    for (const bool with_rooms : {false, true})
+    {
+        std::cout << (with_rooms ? "registry + 5 room joins per connection\n" : "registry only\n");
+        for (const std::size_t threads : {1, 2, 4, 8, 16})
+        {
+            const int users_per_thread = kSockets / static_cast<int>(threads);
+            const auto single_lock = ReconnectsPerSecond<LegacyConnections>(threads, users_per_thread, with_rooms);
+            const auto sharded = ReconnectsPerSecond<ShardedConnections>(threads, users_per_thread, with_rooms);
+            std::cout << std::format("{:>2} threads: single lock {:>12.0f} reconnects/s   sharded {:>12.0f} "
+                                     "reconnects/s   x{:.2f}\n",
+                                     threads, single_lock, sharded, sharded / single_lock);
+        }
+    }
+    return 0;
+}
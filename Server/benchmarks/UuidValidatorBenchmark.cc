@@ -0,0 +1,128 @@
+/**
+ *
+ *  UuidValidatorBenchmark.cc
+ *
+ *  Cost of checking a jti with the case-insensitive std::regex JwtTokenManager used to run, versus IsUuid.
+ *  Before timing anything, both are run on random mutations of valid UUIDs (byte substitutions, insertions, deletions
+ *  and case changes) and the benchmark fails if they ever disagree.
+ *
+ */
+
+#include "BenchmarkUtil.h"
+#include "utilities/UuidValidator.h"
+
+#include <random>
+#include <regex>
+
+using namespace server::benchmarks;
+using namespace server::utilities;
+
+namespace
+{
+constexpr std::size_t kFuzzCases{1'000'000};
+constexpr std::size_t kRepetitions{200000};
+
+const std::regex &UuidRegex()
+{
+    static const std::regex reg("^[0-9a-f]{8}-[0-9a-f]{4}-[0-5][0-9a-f]{3}-[089ab][0-9a-f]{3}-[0-9a-f]{12}$",
+                                std::regex_constants::icase);
+    return reg;
+}
+
+std::string RandomUuid(std::mt19937_64 &rng)
+{
+    static constexpr std::string_view kHexDigits{"0123456789abcdef"};
+    std::string uuid(36, '-');
+    for (std::size_t i = 0; i < uuid.size(); ++i)
+    {
+        if (i != 8 && i != 13 && i != 18 && i != 23)
+        {
+            uuid[i] = kHexDigits[rng() % kHexDigits.size()];
+        }
+    }
+    // Valid half the time, so the version and variant rules are exercised both ways.
+    if (rng() % 2 == 0)
+    {
+        uuid[14] = "012345"[rng() % 6];
+        uuid[19] = "089ab"[rng() % 5];
+    }
+    return uuid;
+}
+
+// A few edits biased towards characters near the accepted ones, or no edit at all.
+std::string Mutate(std::string value, std::mt19937_64 &rng)
+{
+    static constexpr std::string_view kNearby{"0123456789abcdefgABCDEFG-_ /:@`\n"};
+    const auto edits = rng() % 4;
+    for (std::size_t edit = 0; edit < edits; ++edit)
+    {
+        const auto position = value.empty() ? 0 : rng() % value.size();
+        const auto c = rng() % 4 == 0 ? static_cast<char>(rng() % 256) : kNearby[rng() % kNearby.size()];
+        switch (rng() % 4)
+        {
+        case 0:
+            if (!value.empty())
+            {
+                value[position] = c;
+            }
+            break;
+        case 1:
+            value.insert(value.begin() + static_cast<std::ptrdiff_t>(position), c);
+            break;
+        case 2:
+            if (!value.empty())
+            {
+                value.erase(position, 1);
+            }
+            break;
+        default:
+            if (!value.empty())
+            {
+                value[position] = static_cast<char>(std::toupper(static_cast<unsigned char>(value[position])));
+            }
+            break;
+        }
+    }
+    return value;
+}
+
+bool CheckEquivalence()
+{
+    std::mt19937_64 rng(42);
+    std::size_t accepted = 0;
+    for (std::size_t i = 0; i < kFuzzCases; ++i)
+    {
+        const auto value = Mutate(RandomUuid(rng), rng);
+        const bool expected = std::regex_match(value, UuidRegex());
+        if (IsUuid(value) != expected)
+        {
+            std::cout << std::format("mismatch on {:?}: regex {}, IsUuid {}\n", value, expected, !expected);
+            return false;
+        }
+        accepted += expected;
+    }
+    std::cout << std::format("{} fuzz cases agree ({} accepted)\n", kFuzzCases, accepted);
+    return true;
+}
+} // namespace
+
+int main()
+{
+    if (!CheckEquivalence())
+    {
+        return 1;
+    }
+
+    for (const auto &[name, value] : {std::pair{"valid jti", std::string("123e4567-e89b-12d3-a456-426614174000")},
+                                      std::pair{"invalid jti", std::string("123e4567-e89b-12d3-a456-42661417400g")}})
+    {
+        std::cout << std::format("{}\n", name);
+        // Read through a volatile pointer so that the checks cannot be hoisted out of the loop.
+        const std::string *volatile input = &value;
+        std::size_t accepted = 0;
+        Report("  std::regex icase", Measure(kRepetitions, [&] { accepted += std::regex_match(*input, UuidRegex()); }));
+        Report("  IsUuid", Measure(kRepetitions, [&] { accepted += IsUuid(*input); }));
+        std::cout << std::format("  ({} accepted)\n", accepted);
+    }
+    return 0;
+}
@@ -1,8 +1,10 @@
 #include "Auth.h"
 #include "models/Helper.h"
 #include "plugins/JwtTokenManager.h"
+#include "plugins/LoginThrottle.h"
 #include "plugins/PasswordHasher.h"
 #include "plugins/RedisManager.h"
+#include "plugins/UserCache.h"
 #include "utilities/FormatterUtil.h"
 #include "utilities/HttpResponseUtil.h"
 
@@ -18,6 +20,8 @@ Auth::Auth()
     ASSERT(app().getPlugin<JwtTokenManager>() != nullptr, "JwtTokenManager plugin is not loaded");
     ASSERT(app().getPlugin<RedisManager>() != nullptr, "RedisManager plugin is not loaded");
     ASSERT(app().getPlugin<PasswordHasher>() != nullptr, "PasswordHasher plugin is not loaded");
+    ASSERT(app().getPlugin<LoginThrottle>() != nullptr, "LoginThrottle plugin is not loaded");
+    ASSERT(app().getPlugin<UserCache>() != nullptr, "UserCache plugin is not loaded");
 }
 
 Task<HttpResponsePtr> Auth::CoroRegister(const HttpRequestPtr req)
@@ -49,11 +53,16 @@ Task<HttpResponsePtr> Auth::CoroRegister(const HttpRequestPtr req)
         co_return utilities::NewJsonErrorResponse<HttpErrorCode::kDatabaseError>();
     }
 
-    auto password_hashing_result = app().getPlugin<PasswordHasher>()->HashPassword((*json_ptr)["password"].asString());
+    auto password_hashing_result =
+        co_await app().getPlugin<PasswordHasher>()->HashPasswordAsync((*json_ptr)["password"].asString());
     if (!password_hashing_result)
     {
-        LOG_ERROR << fmt::format("{}", password_hashing_result.error());
-        co_return utilities::NewJsonErrorResponse<HttpErrorCode::kInternalServerError>();
+        if (const auto *e = std::get_if<Botan::Exception>(&password_hashing_result.error()))
+        {
+            LOG_ERROR << fmt::format("{}", *e);
+            co_return utilities::NewJsonErrorResponse<HttpErrorCode::kInternalServerError>();
+        }
+        co_return utilities::NewJsonErrorResponse<HttpErrorCode::kServiceUnavailableError>();
     }
     (*json_ptr)["password"] = std::move(password_hashing_result).value();
 
@@ -91,16 +100,21 @@ Task<HttpResponsePtr> Auth::CoroLogin(const HttpRequestPtr req)
 
     const auto username = (*json_ptr)["username"].asString();
     const auto password = (*json_ptr)["password"].asString();
+    const auto address = req->getPeerAddr().toIp();
+    auto *const login_throttle = app().getPlugin<LoginThrottle>();
+    if (!co_await login_throttle->Allow(username, address))
+    {
+        co_return utilities::NewJsonErrorResponse(k429TooManyRequests, "Too many failed login attempts");
+    }
+
     CoroMapper<User> mapper{app().getDbClient()};
-    User user;
+    std::optional<User> user;
     try
     {
-        auto users = co_await mapper.findBy({User::Cols::_username, CompareOperator::EQ, username});
-        if (users.empty())
+        if (auto users = co_await mapper.findBy({User::Cols::_username, CompareOperator::EQ, username}); !users.empty())
         {
-            co_return utilities::NewJsonErrorResponse(k401Unauthorized, "Invalid username");
+            user = std::move(users.front());
         }
-        user = std::move(users.front());
     }
     catch (const DrogonDbException &e)
     {
@@ -108,36 +122,47 @@ Task<HttpResponsePtr> Auth::CoroLogin(const HttpRequestPtr req)
         co_return utilities::NewJsonErrorResponse<HttpErrorCode::kDatabaseError>();
     }
 
-    auto password_check_result = app().getPlugin<PasswordHasher>()->VerifyPassword(password, user.getValueOfPassword());
+    // Unknown usernames are checked against a dummy hash: the answer takes as long, and reads the same, as for a
+    // wrong password.
+    auto *const password_hasher = app().getPlugin<PasswordHasher>();
+    auto password_check_result = co_await password_hasher->VerifyPasswordAsync(
+        password, user ? user->getValueOfPassword() : password_hasher->DummyHash());
     if (!password_check_result)
     {
-        LOG_ERROR << fmt::format("{}", password_check_result.error());
-        co_return utilities::NewJsonErrorResponse<HttpErrorCode::kInternalServerError>();
+        if (const auto *e = std::get_if<Botan::Exception>(&password_check_result.error()))
+        {
+            LOG_ERROR << fmt::format("{}", *e);
+            co_return utilities::NewJsonErrorResponse<HttpErrorCode::kInternalServerError>();
+        }
+        co_return utilities::NewJsonErrorResponse<HttpErrorCode::kServiceUnavailableError>();
     }
-    if (!password_check_result.value())
+    if (!user || !password_check_result.value())
     {
-        co_return utilities::NewJsonErrorResponse(k401Unauthorized, "Invalid password");
+        login_throttle->RecordFailure(username, address);
+        co_return utilities::NewJsonErrorResponse(k401Unauthorized, "Invalid username or password");
     }
+    login_throttle->RecordSuccess(username);
 
-    const auto refresh_token = app().getPlugin<JwtTokenManager>()->GenerateRefreshToken(user);
-    const auto access_token = app().getPlugin<JwtTokenManager>()->GenerateAccessToken(refresh_token, user);
-    const auto redis_result = co_await app().getPlugin<RedisManager>()->StoreRefreshTokenId(refresh_token, access_token);
+    const auto refresh_token = app().getPlugin<JwtTokenManager>()->GenerateRefreshToken(*user);
+    const auto access_token = app().getPlugin<JwtTokenManager>()->GenerateAccessToken(refresh_token.context, *user);
+    const auto redis_result =
+        co_await app().getPlugin<RedisManager>()->StoreRefreshTokenId(refresh_token.context, access_token.context);
     if (!redis_result)
     {
         LOG_ERROR << fmt::format("{}", redis_result.error());
         co_return utilities::NewJsonErrorResponse<HttpErrorCode::kCacheDatabaseError>();
     }
 
-    app().getPlugin<RedisManager>()->StoreUserInRedisAsync(user);
+    app().getPlugin<UserCache>()->Store(*user);
 
     Json::Value ret;
-    ret["access_token"] = access_token;
-    ret["access_expiration"] = utilities::ToSeconds(jwt::decode(access_token).get_expires_at().time_since_epoch());
-    ret["refresh_token"] = refresh_token;
-    ret["refresh_expiration"] = utilities::ToSeconds(jwt::decode(refresh_token).get_expires_at().time_since_epoch());
+    ret["access_token"] = access_token.token;
+    ret["access_expiration"] = utilities::ToSeconds(access_token.context.expires_at.time_since_epoch());
+    ret["refresh_token"] = refresh_token.token;
+    ret["refresh_expiration"] = utilities::ToSeconds(refresh_token.context.expires_at.time_since_epoch());
     const auto resp = HttpResponse::newHttpJsonResponse(std::move(ret));
 
-    LOG_INFO << std::format("User {} logged in", user.getValueOfUsername());
+    LOG_INFO << std::format("User {} logged in", user->getValueOfUsername());
     co_return resp;
 }
 
@@ -154,44 +179,47 @@ Task<HttpResponsePtr> Auth::CoroRefresh(const HttpRequestPtr req)
         co_return utilities::NewJsonErrorResponse(k400BadRequest, "Refresh token is required");
     }
 
-    const auto refresh_token = (*json_ptr)["refresh_token"].asString();
-    if (const auto validation_result = app().getPlugin<JwtTokenManager>()->ValidateToken(refresh_token); !validation_result)
+    const auto refresh = app().getPlugin<JwtTokenManager>()->ValidateToken((*json_ptr)["refresh_token"].asString());
+    if (!refresh)
     {
         co_return utilities::NewJsonErrorResponse(k401Unauthorized, "Invalid refresh token");
     }
 
-
-    const auto refresh_token_exists = co_await app().getPlugin<RedisManager>()->HasRefreshToken(refresh_token);
-    if (!refresh_token_exists.has_value())
+    // The new access token's id is installed before the token is signed, so that checking the refresh token,
+    // revoking the previous access token and fetching the cached user take a single round trip. A user cached in
+    // process is not fetched again.
+    const auto access_token_id = drogon::utils::getUuid();
+    const auto access_expires_at = app().getPlugin<JwtTokenManager>()->NextAccessTokenExpiry();
+    const auto user_cache = app().getPlugin<UserCache>();
+    const auto user_read_start = std::chrono::steady_clock::now();
+    std::optional<User> user = user_cache->FindLocal(refresh->user_id);
+    auto rotation = co_await app().getPlugin<RedisManager>()->RotateAccessToken(*refresh, access_token_id,
+                                                                                access_expires_at, !user);
+    if (!rotation)
     {
-        LOG_ERROR << fmt::format("{}", refresh_token_exists.error());
+        LOG_ERROR << fmt::format("{}", rotation.error());
         co_return utilities::NewJsonErrorResponse<HttpErrorCode::kCacheDatabaseError>();
     }
 
-    if (!(*refresh_token_exists))
+    if (!rotation->refresh_token_found)
     {
         co_return utilities::NewJsonErrorResponse(k401Unauthorized, "Invalid refresh token");
     }
 
-    std::optional<User> user;
-    auto user_redis_result = co_await app().getPlugin<RedisManager>()->GetUserFromRedis(
-        std::stoi(jwt::decode(refresh_token).get_subject().c_str()));
-    if (!user_redis_result)
-    {
-        LOG_ERROR << fmt::format("{}", user_redis_result.error());
-    }
-    else if (user_redis_result->has_value())
+    if (rotation->user)
     {
-        user = std::move(user_redis_result).value();
+        user = std::move(rotation->user);
+        user_cache->InsertFromRedis(*user, user_read_start);
     }
 
+    // Not cached anywhere. Unless the Redis record was unreadable, nothing was rotated yet, so the previous access
+    // token stays valid if the lookup fails.
     if (!user)
     {
         CoroMapper<User> mapper{app().getDbClient()};
         try
         {
-            User::PrimaryKeyType user_id = std::stoi(jwt::decode(refresh_token).get_subject());
-            user = co_await mapper.findByPrimaryKey(user_id);
+            user = co_await mapper.findByPrimaryKey(refresh->user_id);
         }
         catch (const DrogonDbException &e)
         {
@@ -202,19 +230,30 @@ Task<HttpResponsePtr> Auth::CoroRefresh(const HttpRequestPtr req)
             LOG_ERROR << e.base().what();
             co_return utilities::NewJsonErrorResponse<HttpErrorCode::kDatabaseError>();
         }
-        app().getPlugin<RedisManager>()->StoreUserInRedisAsync(*user);
+        user_cache->Store(*user);
     }
 
-    const auto access_token = app().getPlugin<JwtTokenManager>()->GenerateAccessToken(refresh_token, *user);
-    if (const auto store_result = co_await app().getPlugin<RedisManager>()->StoreRefreshTokenId(refresh_token, access_token); !store_result)
+    if (!rotation->rotated)
     {
-        LOG_ERROR << fmt::format("{}", store_result.error());
-        co_return utilities::NewJsonErrorResponse<HttpErrorCode::kCacheDatabaseError>();
+        rotation = co_await app().getPlugin<RedisManager>()->RotateAccessToken(*refresh, access_token_id,
+                                                                               access_expires_at, false);
+        if (!rotation)
+        {
+            LOG_ERROR << fmt::format("{}", rotation.error());
+            co_return utilities::NewJsonErrorResponse<HttpErrorCode::kCacheDatabaseError>();
+        }
+        if (!rotation->refresh_token_found)
+        {
+            co_return utilities::NewJsonErrorResponse(k401Unauthorized, "Invalid refresh token");
+        }
     }
 
+    const auto access_token = app().getPlugin<JwtTokenManager>()->GenerateAccessToken(*refresh, *user, access_token_id,
+                                                                                      access_expires_at);
+
     Json::Value ret;
-    ret["access_token"] = access_token;
-    ret["access_expiration"] = utilities::ToSeconds(jwt::decode(access_token).get_expires_at().time_since_epoch());
+    ret["access_token"] = access_token.token;
+    ret["access_expiration"] = utilities::ToSeconds(access_token.context.expires_at.time_since_epoch());
     const auto resp = HttpResponse::newHttpJsonResponse(std::move(ret));
 
     LOG_INFO << std::format("User {} refreshed token", user->getValueOfUsername());
@@ -234,13 +273,14 @@ Task<HttpResponsePtr> Auth::CoroLogout(const HttpRequestPtr req)
         co_return utilities::NewJsonErrorResponse(k400BadRequest, "Refresh token is required");
     }
 
-    const auto refresh_token = (*json_ptr)["refresh_token"].asString();
-    if (const auto validation_result = app().getPlugin<JwtTokenManager>()->ValidateToken(refresh_token); !validation_result)
+    const auto refresh = app().getPlugin<JwtTokenManager>()->ValidateToken((*json_ptr)["refresh_token"].asString());
+    if (!refresh)
     {
         co_return utilities::NewJsonErrorResponse(k401Unauthorized, "Invalid refresh token");
     }
 
-    if (const auto deleted_count = co_await app().getPlugin<RedisManager>()->DeleteRefreshToken(refresh_token); !deleted_count)
+    if (const auto deleted_count = co_await app().getPlugin<RedisManager>()->DeleteRefreshToken(*refresh);
+        !deleted_count)
     {
         LOG_ERROR << fmt::format("{}", deleted_count.error());
         co_return utilities::NewJsonErrorResponse<HttpErrorCode::kCacheDatabaseError>();
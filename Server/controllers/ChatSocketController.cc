@@ -1,34 +1,185 @@
 #include "ChatSocketController.h"
+#include "models/Message.h"
+#include "models/RoomMembership.h"
+#include "plugins/AccessTokenCache.h"
+#include "plugins/PresenceTracker.h"
 #include "plugins/RedisManager.h"
+#include "realtime/MsgPackCodec.h"
+#include "realtime/WebSocketFrame.h"
 
+#include <charconv>
+#include <drogon/orm/CoroMapper.h>
+#include <unordered_set>
+
+using namespace drogon::orm;
+using namespace server::realtime;
 using namespace server::ws;
 
+struct EphemeralState
+{
+    bool active{false};
+    RoomThrottle::Clock::time_point last_sent;
+};
+
 struct ClientContext
 {
     User::PrimaryKeyType user_id;
-    std::chrono::system_clock::time_point last_online_update;
+    std::string refresh_token_id;
+    std::vector<Room::PrimaryKeyType> room_ids;
+    WireFormat wire_format{WireFormat::kJson};
+    std::weak_ptr<trantor::TcpConnection> tcp_conn;
+    std::shared_ptr<OutboundQueue> outbound_queue;
+    // Heartbeat wheel of the connection's loop; activity is recorded in its ticks, so frames never read the clock.
+    const TimingWheel<std::weak_ptr<WebSocketConnection>> *heartbeat_wheel{nullptr};
+    uint64_t last_activity_tick{0};
+    uint64_t last_presence_tick{0};
+    // Keyed by "<type>:<room_id>", only touched from the connection's loop. Pruned by the heartbeat once debounced.
+    std::unordered_map<std::string, EphemeralState> ephemeral_states;
+    // Rooms receiving full events; every room until the client sends its first subscribe/unsubscribe frame.
+    // Only touched from the connection's loop.
+    std::optional<std::unordered_set<Room::PrimaryKeyType>> subscribed_room_ids;
+    bool bump_unsubscribed_rooms{true};
+
+    bool IsSubscribed(const Room::PrimaryKeyType room_id) const
+    {
+        return !subscribed_room_ids || subscribed_room_ids->contains(room_id);
+    }
 };
 
-ChatSocketController::ChatSocketController()
+namespace
 {
-    user_online_update_interval_ =
-        std::chrono::seconds(app().getCustomConfig().get("user_online_update_interval", 2 * 60).asUInt());
-    ASSERT(app().getPlugin<RedisManager>() != nullptr, "RedisManager plugin is not loaded");
-    const auto redis_client = app().getRedisClient();
-    try
+constexpr std::chrono::seconds kSlowConsumerCloseGrace{5};
+constexpr std::size_t kHeartbeatWheelSlots{512};
+
+uint64_t ToTicks(const std::chrono::milliseconds interval, const std::chrono::milliseconds tick)
+{
+    return std::max<uint64_t>(interval / tick, 1);
+}
+
+WebSocketMessageType FrameType(const WireFormat format)
+{
+    return format == WireFormat::kMsgPack ? WebSocketMessageType::Binary : WebSocketMessageType::Text;
+}
+
+// Writes a frame around the outbound queue, e.g. an error reply or a final event before a close, and counts it
+// towards the queue's unsent window.
+void SendDirect(const WebSocketConnectionPtr &ws_conn, const std::string_view payload,
+                const WebSocketMessageType type)
+{
+    ws_conn->getContextRef<ClientContext>().outbound_queue->RecordDirectWrite(ServerFrameSize(payload.size()));
+    ws_conn->send(payload.data(), payload.size(), type);
+}
+
+void SendEvent(const WebSocketConnectionPtr &ws_conn, Json::Value event)
+{
+    const auto format = ws_conn->getContextRef<ClientContext>().wire_format;
+    SendDirect(ws_conn, EncodedEvent(std::move(event)).Payload(format), FrameType(format));
+}
+
+OutboundQueue::Entry DurableEntry(EncodedEvent &event, const WireFormat format)
+{
+    return {event.Frame(format), EventClass::kDurable, {}};
+}
+
+Json::Value BumpEvent(const Room::PrimaryKeyType room_id, const ReplayBuffer::Sequence seq)
+{
+    Json::Value event;
+    event["type"] = "bump";
+    event["room_id"] = room_id;
+    if (seq != 0)
     {
-        auto success = redis_client->execCommandSync<bool>(
-            [](const nosql::RedisResult &result) { return result.asString() == "OK"; },
-            "CONFIG SET notify-keyspace-events Kxg");
-        ASSERT(success, "Failed to set notify-keyspace-events");
+        event["seq"] = Json::UInt64{seq};
     }
-    catch (const drogon::nosql::RedisException &e)
+    return event;
+}
+
+void SendError(const WebSocketConnectionPtr &ws_conn, const std::string &message)
+{
+    Json::Value ret = Json::objectValue;
+    ret["type"] = "error";
+    ret["message"] = message;
+    SendEvent(ws_conn, std::move(ret));
+}
+
+std::expected<Json::Value, std::string> ParseRequest(const std::string &message, const WebSocketMessageType type)
+{
+    if (type == WebSocketMessageType::Binary)
+    {
+        return DecodeMsgPack(message);
+    }
+    static const Json::CharReaderBuilder reader_builder;
+    const std::unique_ptr<Json::CharReader> reader(reader_builder.newCharReader());
+    Json::Value request;
+    if (std::string errs; !reader->parse(message.data(), message.data() + message.size(), &request, &errs))
+    {
+        return std::unexpected(std::move(errs));
+    }
+    return request;
+}
+
+// Parses "<room_id>:<last_seq>,..." and ignores malformed entries.
+std::unordered_map<Room::PrimaryKeyType, ReplayBuffer::Sequence> ParseResumePoints(const std::string_view resume)
+{
+    std::unordered_map<Room::PrimaryKeyType, ReplayBuffer::Sequence> resume_points;
+    for (const auto entry : resume | std::views::split(','))
     {
-        ASSERT(true, e.what());
+        const std::string_view point(entry.begin(), entry.end());
+        const auto separator = point.find(':');
+        if (separator == std::string_view::npos)
+        {
+            continue;
+        }
+        Room::PrimaryKeyType room_id{};
+        ReplayBuffer::Sequence last_seq{};
+        const auto room_end = point.data() + separator;
+        const auto point_end = point.data() + point.size();
+        const auto room_result = std::from_chars(point.data(), room_end, room_id);
+        const auto seq_result = std::from_chars(room_end + 1, point_end, last_seq);
+        if (room_result.ec != std::errc{} || room_result.ptr != room_end || seq_result.ec != std::errc{} ||
+            seq_result.ptr != point_end)
+        {
+            continue;
+        }
+        resume_points[room_id] = last_seq;
     }
-    refresh_token_change_subscriber_ = redis_client->newSubscriber();
+    return resume_points;
+}
+} // namespace
+
+ChatSocketController::ChatSocketController()
+{
+    const auto &heartbeat_config = app().getCustomConfig()["heartbeat"];
+    heartbeat_tick_ = std::chrono::milliseconds(std::max(heartbeat_config.get("tick_ms", 1000).asUInt(), 1u));
+    ping_interval_ticks_ =
+        ToTicks(std::chrono::seconds(heartbeat_config.get("ping_interval", 20).asUInt()), heartbeat_tick_);
+    dead_peer_ticks_ =
+        ToTicks(std::chrono::seconds(heartbeat_config.get("dead_peer_timeout", 50).asUInt()), heartbeat_tick_);
+    presence_interval_ticks_ = ToTicks(
+        std::chrono::seconds(app().getCustomConfig().get("user_online_update_interval", 2 * 60).asUInt()),
+        heartbeat_tick_);
+    const auto &outbound_config = app().getCustomConfig()["outbound_queue"];
+    outbound_limits_.max_bytes = outbound_config.get("max_bytes", 1024 * 1024).asUInt64();
+    outbound_limits_.max_messages = outbound_config.get("max_messages", 1024).asUInt64();
+    outbound_limits_.wire_window_bytes = outbound_config.get("wire_window_bytes", 256 * 1024).asUInt64();
+    outbound_retry_interval_ = std::chrono::milliseconds(outbound_config.get("retry_interval_ms", 50).asUInt());
+    replay_buffer_ =
+        std::make_unique<ReplayBuffer>(app().getCustomConfig().get("replay_events_per_room", 256).asUInt64());
+    const auto &ephemeral_config = app().getCustomConfig()["ephemeral_events"];
+    ephemeral_debounce_interval_ = std::chrono::milliseconds(ephemeral_config.get("debounce_ms", 2000).asUInt());
+    ephemeral_throttle_ =
+        std::make_unique<RoomThrottle>(ephemeral_config.get("room_events_per_second_per_node", 20).asDouble(),
+                                       ephemeral_config.get("room_burst_per_node", 40).asDouble());
+    ASSERT(app().getPlugin<RedisManager>() != nullptr, "RedisManager plugin is not loaded");
+    ASSERT(app().getPlugin<PresenceTracker>() != nullptr, "PresenceTracker plugin is not loaded");
+    // Also enables the refresh_token:* keyspace notifications subscribed to below.
+    ASSERT(app().getPlugin<AccessTokenCache>() != nullptr, "AccessTokenCache plugin is not loaded");
+    const auto redis_client = app().getRedisClient();
+    redis_subscriber_ = redis_client->newSubscriber();
+    room_relay_ = std::make_unique<realtime::RoomRelay>(
+        redis_client, redis_subscriber_,
+        [this](std::vector<RoomRelay::Event> relayed) { DeliverRelayed(std::move(relayed)); });
     auto redis_db_index = app().getCustomConfig()["redis_clients"].get("db_index", 0).asUInt();
-    refresh_token_change_subscriber_->psubscribe(
+    redis_subscriber_->psubscribe(
         std::format("__keyspace@{}__:refresh_token:*", redis_db_index),
         [this](const std::string &channel, const std::string &message) {
             if (message == "expired" || message == "del")
@@ -39,21 +190,14 @@ ChatSocketController::ChatSocketController()
                         std::views::transform([](auto &&range) { return std::string(range.begin(), range.end()); }),
                     parts.begin());
 
-                auto user_id = std::stoull(parts[0]);
-                if (auto it = websocket_connections_.find(user_id);
-                    it != websocket_connections_.end())
+                const User::PrimaryKeyType user_id = std::stoi(parts[0]);
+                if (const auto ws_conn = websocket_connections_.Find(user_id, parts[1]))
                 {
-                    if (auto it2 = std::ranges::find_if(it->second,
-                                                        [&parts](const auto &pair) { return pair.first == parts[1]; });
-                        it2 != it->second.end())
-                    {
-                        auto &ws_conn = it2->second;
-                        Json::Value ret = Json::objectValue;
-                        ret["type"] = "disconnect";
-                        ret["message"] = "refresh token expired";
-                        ws_conn->sendJson(ret);
-                        ws_conn->forceClose();
-                    }
+                    Json::Value ret = Json::objectValue;
+                    ret["type"] = "disconnect";
+                    ret["message"] = "refresh token expired";
+                    SendEvent(ws_conn, std::move(ret));
+                    ws_conn->forceClose();
                 }
             }
         });
@@ -62,80 +206,595 @@ ChatSocketController::ChatSocketController()
 void ChatSocketController::handleNewMessage(const WebSocketConnectionPtr &wsConnPtr, std::string &&message,
                                             const WebSocketMessageType &type)
 {
-    std::shared_lock lock(websocket_connections_mutex_);
-    const auto user_id = wsConnPtr->getContextRef<ClientContext>().user_id;
-    if (type == WebSocketMessageType::Ping || type == WebSocketMessageType::Pong || type == WebSocketMessageType::Close)
+    // Any frame proves the peer alive; presence is written from the heartbeat wheel.
+    auto &context = wsConnPtr->getContextRef<ClientContext>();
+    context.last_activity_tick = context.heartbeat_wheel->CurrentTick();
+    if (type == WebSocketMessageType::Ping)
     {
-        if (auto &last_online_update_ = wsConnPtr->getContextRef<ClientContext>().last_online_update;
-            std::chrono::system_clock::now() - last_online_update_ > user_online_update_interval_)
-        {
-            last_online_update_ = std::chrono::system_clock::now();
-            app().getPlugin<RedisManager>()->SetUserLastOnline(user_id, last_online_update_);
-        }
+        // Drogon answers with a pong echoing the payload.
+        context.outbound_queue->RecordDirectWrite(ServerFrameSize(message.size()));
+        return;
+    }
+    if (type == WebSocketMessageType::Pong || type == WebSocketMessageType::Close)
+    {
+        return;
+    }
+    if (type != WebSocketMessageType::Text && type != WebSocketMessageType::Binary)
+    {
+        SendDirect(wsConnPtr, "Invalid message type", WebSocketMessageType::Text);
         return;
     }
-    if (type != WebSocketMessageType::Text)
+
+    auto request = ParseRequest(message, type);
+    if (!request || !request->isObject())
     {
-        wsConnPtr->send("Invalid message type");
+        SendError(wsConnPtr, "Invalid message");
         return;
     }
 
-    //for (const auto &[id, conn] : websocket_connections_)
-    //{
-    //    if (id != user_id)
-    //    {
-    //        conn->send(message);
-    //    }
-    //}
+    const auto request_type = (*request)["type"].asString();
+    if (request_type == "message")
+    {
+        HandleChatMessage(wsConnPtr, std::move(request).value());
+        return;
+    }
+    if (request_type == "subscribe" || request_type == "unsubscribe")
+    {
+        HandleSubscription(wsConnPtr, *request);
+        return;
+    }
+    if (request_type == "typing" || request_type == "viewing")
+    {
+        HandleEphemeralEvent(wsConnPtr, *request);
+        return;
+    }
+    SendError(wsConnPtr, "Unknown message type");
 }
 
-void ChatSocketController::handleNewConnection(const HttpRequestPtr &req, const WebSocketConnectionPtr &wsConnPtr)
+void ChatSocketController::BroadcastToRoom(const Room::PrimaryKeyType room_id, Json::Value event,
+                                           const ReplayBuffer::Sequence seq)
+{
+    if (seq != 0)
+    {
+        event["seq"] = Json::UInt64{seq};
+    }
+    RoomEvent room_event{EncodedEvent(std::move(event)), seq};
+    if (seq != 0)
+    {
+        replay_buffer_->Record(room_id, seq, room_event.event.Payload(WireFormat::kJson));
+    }
+    DeliverToRoom(room_id, room_event);
+    room_relay_->Publish(room_id, seq, room_event.event.Payload(WireFormat::kJson));
+}
+
+void ChatSocketController::BroadcastEphemeral(const Room::PrimaryKeyType room_id, Json::Value event,
+                                              const std::string &coalesce_key)
+{
+    RoomEvent room_event{EncodedEvent(std::move(event)), 0, EventClass::kEphemeral, coalesce_key};
+    DeliverToRoom(room_id, room_event);
+    room_relay_->Publish(room_id, 0, room_event.event.Payload(WireFormat::kJson), coalesce_key);
+}
+
+void ChatSocketController::DeliverToRoom(const Room::PrimaryKeyType room_id, RoomEvent &event)
+{
+    LoopBatches batches;
+    CollectDeliveries(room_id, std::span(&event, 1), batches);
+    DispatchBatches(std::move(batches));
+}
+
+void ChatSocketController::DeliverRelayed(std::vector<RoomRelay::Event> relayed)
+{
+    // Events of one room keep their arrival order; the order across rooms does not matter.
+    std::ranges::stable_sort(relayed, {}, &RoomRelay::Event::room_id);
+    LoopBatches batches;
+    std::vector<RoomEvent> events;
+    for (auto first = relayed.begin(); first != relayed.end();)
+    {
+        const auto room_id = first->room_id;
+        const auto last = std::find_if(first, relayed.end(),
+                                       [room_id](const RoomRelay::Event &event) { return event.room_id != room_id; });
+        events.clear();
+        for (auto &[_, seq, coalesce_key, payload] : std::ranges::subrange(first, last))
+        {
+            if (seq != 0)
+            {
+                replay_buffer_->Record(room_id, seq, payload);
+            }
+            const auto event_class = coalesce_key.empty() ? EventClass::kDurable : EventClass::kEphemeral;
+            events.push_back(
+                {EncodedEvent::FromJsonText(std::move(payload)), seq, event_class, std::move(coalesce_key)});
+        }
+        CollectDeliveries(room_id, events, batches);
+        first = last;
+    }
+    DispatchBatches(std::move(batches));
+}
+
+void ChatSocketController::CollectDeliveries(const Room::PrimaryKeyType room_id, const std::span<RoomEvent> events,
+                                             LoopBatches &batches)
 {
-    auto user_id = req->getAttributes()->get<User::PrimaryKeyType>("id");
-    auto refresh_token_id = req->getAttributes()->get<std::string>("refresh_id");
-    auto now = std::chrono::system_clock::now();
-    app().getPlugin<RedisManager>()->SetUserLastOnline(user_id, now);
-    wsConnPtr->setContext(std::make_shared<ClientContext>(ClientContext{user_id, std::move(now)}));
+    std::vector<std::pair<trantor::EventLoop *, std::vector<WebSocketConnectionPtr>>> owners;
+    room_index_.ForEachOwner(
+        room_id, [&owners](trantor::EventLoop *const loop, const std::span<const WebSocketConnectionPtr> members) {
+            owners.emplace_back(loop, std::vector(members.begin(), members.end()));
+        });
+    fanout_metrics_.broadcasts.fetch_add(events.size(), std::memory_order_relaxed);
+    if (owners.empty())
+    {
+        return;
+    }
 
+    bool uses_json{false};
+    bool uses_msgpack{false};
+    for (const auto &[_, members] : owners)
     {
-        std::shared_lock read_lock(websocket_connections_mutex_);
-        if (websocket_connections_.contains(user_id) && websocket_connections_[user_id].contains(refresh_token_id))
+        for (const auto &conn : members)
         {
-            auto &old_ws_conn = websocket_connections_.at(user_id).at(refresh_token_id);
-            Json::Value message;
-            message["type"] = "disconnect";
-            message["message"] = "duplicate connection";
-            old_ws_conn->sendJson(message);
-            old_ws_conn->forceClose();
-            read_lock.unlock();
-            std::unique_lock write_lock(websocket_connections_mutex_);
-            websocket_connections_[user_id][refresh_token_id] = wsConnPtr;
-            return;
+            const auto format = conn->getContextRef<ClientContext>().wire_format;
+            uses_json |= format == WireFormat::kJson;
+            uses_msgpack |= format == WireFormat::kMsgPack;
         }
     }
+    auto frames = std::make_shared<std::vector<EventFrames>>();
+    frames->reserve(events.size());
+    std::size_t bytes_encoded{0};
+    for (auto &[event, seq, event_class, coalesce_key] : events)
+    {
+        frames->push_back({seq, event_class, coalesce_key, uses_json ? event.Frame(WireFormat::kJson) : nullptr,
+                           uses_msgpack ? event.Frame(WireFormat::kMsgPack) : nullptr});
+        bytes_encoded += event.EncodedBytes();
+    }
+    fanout_metrics_.bytes_encoded.fetch_add(bytes_encoded, std::memory_order_relaxed);
+    for (auto &[loop, members] : owners)
     {
-        std::unique_lock write_lock(websocket_connections_mutex_);
-        websocket_connections_[user_id][refresh_token_id] = wsConnPtr;
+        batches[loop].push_back({room_id, std::move(members), frames});
     }
 }
 
-void ChatSocketController::handleConnectionClosed(const WebSocketConnectionPtr &wsConnPtr)
+void ChatSocketController::DispatchBatches(LoopBatches batches)
+{
+    for (auto &[loop, batch] : batches)
+    {
+        // One task per loop instead of one cross-thread wakeup per recipient. Always queued, even on the owning
+        // loop, so that events keep their order per connection. Subscriptions are only read on the owning loop.
+        loop->queueInLoop([this, batch = std::move(batch)] { DeliverBatch(batch); });
+    }
+    fanout_metrics_.loop_dispatches.fetch_add(batches.size(), std::memory_order_relaxed);
+}
+
+void ChatSocketController::DeliverBatch(const std::vector<RoomDelivery> &batch)
 {
-    auto user_id = wsConnPtr->getContextRef<ClientContext>().user_id;
-    std::shared_lock read_lock(websocket_connections_mutex_);
-    if (auto it = websocket_connections_.find(user_id); it != websocket_connections_.end())
+    std::size_t recipients{0};
+    std::size_t deliveries{0};
+    std::size_t bumps{0};
+    std::size_t bytes_delivered{0};
+    std::size_t bytes_encoded{0};
+    for (const auto &[room_id, room_recipients, events] : batch)
     {
-        if (auto it2 =
-                std::ranges::find_if(it->second, [wsConnPtr](const auto &pair) { return pair.second == wsConnPtr; });
-            it2 != it->second.end())
+        const auto bump_key = std::format("bump:{}", room_id);
+        recipients += room_recipients.size() * events->size();
+        for (const auto &event : *events)
         {
-            read_lock.unlock();
-            std::unique_lock write_lock(websocket_connections_mutex_);
-            it->second.erase(it2);
-            if (it->second.empty())
+            // Connections not subscribed to the room only learn that it moved on. The bump is the same for every one
+            // of them and only encoded once one of them wants it; clients derive the unread count from its seq.
+            std::optional<EncodedEvent> bump;
+            for (const auto &conn : room_recipients)
             {
-                websocket_connections_.erase(it);
+                const auto &context = conn->getContextRef<ClientContext>();
+                if (context.IsSubscribed(room_id))
+                {
+                    const auto &frame = event.Frame(context.wire_format);
+                    ++deliveries;
+                    bytes_delivered += frame->size();
+                    Enqueue(conn, {frame, event.event_class, event.coalesce_key});
+                }
+                else if (event.event_class == EventClass::kDurable && context.bump_unsubscribed_rooms)
+                {
+                    if (!bump)
+                    {
+                        bump.emplace(BumpEvent(room_id, event.seq));
+                    }
+                    // Only the latest bump of a room matters, so it may be coalesced or shed like ephemeral events.
+                    const auto &bump_frame = bump->Frame(context.wire_format);
+                    ++bumps;
+                    bytes_delivered += bump_frame->size();
+                    Enqueue(conn, {bump_frame, EventClass::kEphemeral, bump_key});
+                }
             }
+            bytes_encoded += bump ? bump->EncodedBytes() : 0;
+        }
+    }
+    fanout_metrics_.deliveries.fetch_add(deliveries, std::memory_order_relaxed);
+    fanout_metrics_.bumps.fetch_add(bumps, std::memory_order_relaxed);
+    fanout_metrics_.suppressed.fetch_add(recipients - deliveries - bumps, std::memory_order_relaxed);
+    fanout_metrics_.bytes_delivered.fetch_add(bytes_delivered, std::memory_order_relaxed);
+    fanout_metrics_.bytes_encoded.fetch_add(bytes_encoded, std::memory_order_relaxed);
+}
+
+void ChatSocketController::Enqueue(const WebSocketConnectionPtr &ws_conn, OutboundQueue::Entry entry)
+{
+    const auto &context = ws_conn->getContextRef<ClientContext>();
+    if (context.outbound_queue->Push(std::move(entry)) == OutboundQueue::PushResult::kOverflow)
+    {
+        LOG_WARN << std::format("Disconnecting slow consumer: user {}", context.user_id);
+        ws_conn->shutdown(CloseCode::kViolation, "slow consumer");
+        if (const auto tcp_conn = context.tcp_conn.lock())
+        {
+            tcp_conn->getLoop()->runAfter(kSlowConsumerCloseGrace,
+                                          [weak_conn = std::weak_ptr(ws_conn)] {
+                                              if (const auto conn = weak_conn.lock())
+                                              {
+                                                  conn->forceClose();
+                                              }
+                                          });
         }
+        return;
+    }
+    DrainOutbound(ws_conn);
+}
+
+void ChatSocketController::DrainOutbound(const WebSocketConnectionPtr &ws_conn)
+{
+    const auto &context = ws_conn->getContextRef<ClientContext>();
+    const auto tcp_conn = context.tcp_conn.lock();
+    if (!tcp_conn || ws_conn->disconnected())
+    {
+        return;
+    }
+    // Queued entries are complete frames, so they bypass WebSocketConnection::send, which would copy the payload into
+    // a new frame for every recipient. Drogon keeps no per-message state on the send side, so interleaving with its
+    // own control frames is safe at frame granularity.
+    const auto backlogged = context.outbound_queue->Drain(
+        tcp_conn->bytesSent(), [&tcp_conn](const OutboundQueue::Entry &entry) { tcp_conn->send(entry.frame); });
+    // The socket's unsent window is full: poll again once it had a chance to drain.
+    if (backlogged && context.outbound_queue->TryScheduleRetry())
+    {
+        tcp_conn->getLoop()->runAfter(outbound_retry_interval_, [this, weak_conn = std::weak_ptr(ws_conn)] {
+            if (const auto conn = weak_conn.lock())
+            {
+                conn->getContextRef<ClientContext>().outbound_queue->RetryDone();
+                DrainOutbound(conn);
+            }
+        });
+    }
+}
+
+Json::Value ChatSocketController::GetMetrics() const
+{
+    Json::Value metrics;
+    metrics["outbound_queue"] = outbound_metrics_.ToJson();
+    metrics["heartbeat"]["pings"] = Json::UInt64{heartbeat_pings_.load(std::memory_order_relaxed)};
+    metrics["heartbeat"]["dead_peers"] = Json::UInt64{heartbeat_dead_peers_.load(std::memory_order_relaxed)};
+    metrics["fanout"]["broadcasts"] = Json::UInt64{fanout_metrics_.broadcasts.load(std::memory_order_relaxed)};
+    metrics["fanout"]["deliveries"] = Json::UInt64{fanout_metrics_.deliveries.load(std::memory_order_relaxed)};
+    metrics["fanout"]["bumps"] = Json::UInt64{fanout_metrics_.bumps.load(std::memory_order_relaxed)};
+    metrics["fanout"]["suppressed"] = Json::UInt64{fanout_metrics_.suppressed.load(std::memory_order_relaxed)};
+    metrics["fanout"]["loop_dispatches"] =
+        Json::UInt64{fanout_metrics_.loop_dispatches.load(std::memory_order_relaxed)};
+    metrics["fanout"]["bytes_delivered"] =
+        Json::UInt64{fanout_metrics_.bytes_delivered.load(std::memory_order_relaxed)};
+    metrics["fanout"]["bytes_encoded"] = Json::UInt64{fanout_metrics_.bytes_encoded.load(std::memory_order_relaxed)};
+    metrics["ephemeral"]["debounced"] = Json::UInt64{ephemeral_debounced_.load(std::memory_order_relaxed)};
+    metrics["ephemeral"]["throttled"] = Json::UInt64{ephemeral_throttled_.load(std::memory_order_relaxed)};
+    return metrics;
+}
+
+AsyncTask ChatSocketController::LoadRoomMemberships(const WebSocketConnectionPtr ws_conn,
+                                                    const User::PrimaryKeyType user_id, ResumePoints resume_points)
+{
+    auto *const loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+    std::vector<RoomMembership> memberships;
+    try
+    {
+        CoroMapper<RoomMembership> mapper{app().getDbClient()};
+        memberships = co_await mapper.findBy(Criteria{RoomMembership::Cols::_user_id, CompareOperator::EQ, user_id} &&
+                                             Criteria{RoomMembership::Cols::_deleted_at, CompareOperator::IsNull});
+    }
+    catch (const DrogonDbException &e)
+    {
+        LOG_ERROR << e.base().what();
+        co_return;
+    }
+    std::vector<Room::PrimaryKeyType> room_ids;
+    room_ids.reserve(memberships.size());
+    for (const auto &membership : memberships)
+    {
+        room_ids.push_back(membership.getValueOfRoomId());
+    }
+    auto room_seqs = co_await app().getPlugin<RedisManager>()->GetRoomSequences(room_ids);
+    if (!room_seqs)
+    {
+        LOG_ERROR << "Failed to load room sequences";
+    }
+
+    // Register on the connection's own loop so that this cannot interleave with handleConnectionClosed.
+    co_await switchThreadCoro(loop);
+    if (ws_conn->disconnected())
+    {
+        co_return;
+    }
+    auto &context = ws_conn->getContextRef<ClientContext>();
+    Json::Value sequences = Json::arrayValue;
+    for (std::size_t i = 0; i < room_ids.size(); ++i)
+    {
+        const auto room_id = room_ids[i];
+        context.room_ids.push_back(room_id);
+        room_index_.Add(room_id, loop, ws_conn);
+        room_relay_->AddLocalMember(room_id);
+
+        const auto current_seq = room_seqs ? std::optional((*room_seqs)[i]) : std::nullopt;
+        if (const auto resume_it = resume_points.find(room_id);
+            resume_it != resume_points.end() && (!current_seq || resume_it->second < *current_seq))
+        {
+            ReplayRoom(ws_conn, room_id, resume_it->second);
+        }
+        if (current_seq)
+        {
+            Json::Value room_sequence;
+            room_sequence["room_id"] = room_id;
+            room_sequence["seq"] = Json::UInt64{*current_seq};
+            sequences.append(std::move(room_sequence));
+        }
+    }
+    // The connection is online in its rooms from now on, not from its first presence update.
+    app().getPlugin<PresenceTracker>()->Touch(context.user_id, std::chrono::system_clock::now(), context.room_ids);
+    // Lets clients that have not seen any event of a room yet resume it later.
+    Json::Value event;
+    event["type"] = "sequences";
+    event["rooms"] = std::move(sequences);
+    EncodedEvent encoded(std::move(event));
+    const auto format = context.wire_format;
+    Enqueue(ws_conn, DurableEntry(encoded, format));
+}
+
+void ChatSocketController::ReplayRoom(const WebSocketConnectionPtr &ws_conn, const Room::PrimaryKeyType room_id,
+                                      const ReplayBuffer::Sequence last_seq)
+{
+    const auto format = ws_conn->getContextRef<ClientContext>().wire_format;
+    const auto missed_events = replay_buffer_->EventsAfter(room_id, last_seq);
+    if (!missed_events)
+    {
+        Json::Value event;
+        event["type"] = "resync";
+        event["room_id"] = room_id;
+        EncodedEvent encoded(std::move(event));
+        Enqueue(ws_conn, DurableEntry(encoded, format));
+        return;
+    }
+    for (const auto &payload : *missed_events)
+    {
+        auto encoded = EncodedEvent::FromJsonText(payload);
+        Enqueue(ws_conn, DurableEntry(encoded, format));
+    }
+}
+
+AsyncTask ChatSocketController::HandleChatMessage(const WebSocketConnectionPtr ws_conn, const Json::Value request)
+{
+    if (!request["room_id"].isInt() || !request["content"].isString())
+    {
+        SendError(ws_conn, "room_id and content are required");
+        co_return;
+    }
+
+    const auto &context = ws_conn->getContextRef<ClientContext>();
+    const Room::PrimaryKeyType room_id = request["room_id"].asInt();
+    if (!std::ranges::contains(context.room_ids, room_id))
+    {
+        SendError(ws_conn, "Not a member of the room");
+        co_return;
+    }
+
+    Message message;
+    message.setUserId(context.user_id);
+    message.setRoomId(room_id);
+    message.setContent(request["content"].asString());
+    try
+    {
+        CoroMapper<Message> mapper{app().getDbClient()};
+        message = co_await mapper.insert(message);
+    }
+    catch (const DrogonDbException &e)
+    {
+        LOG_ERROR << e.base().what();
+        SendError(ws_conn, "Failed to store message");
+        co_return;
+    }
+
+    const auto seq = co_await app().getPlugin<RedisManager>()->NextRoomSequence(room_id);
+    if (!seq)
+    {
+        // Still delivered live, but clients that miss it will have to resync the room.
+        LOG_ERROR << std::format("Failed to allocate a sequence for room {}", room_id);
+    }
+
+    Json::Value event;
+    event["type"] = "message";
+    event["message"] = message.toJson();
+    BroadcastToRoom(room_id, std::move(event), seq.value_or(0));
+}
+
+void ChatSocketController::HandleEphemeralEvent(const WebSocketConnectionPtr &ws_conn, const Json::Value &request)
+{
+    if (!request["room_id"].isInt() || (request.isMember("active") && !request["active"].isBool()))
+    {
+        SendError(ws_conn, "room_id is required and active must be a boolean");
+        return;
+    }
+
+    auto &context = ws_conn->getContextRef<ClientContext>();
+    const Room::PrimaryKeyType room_id = request["room_id"].asInt();
+    if (!std::ranges::contains(context.room_ids, room_id))
+    {
+        SendError(ws_conn, "Not a member of the room");
+        return;
+    }
+
+    const auto event_type = request["type"].asString();
+    const auto active = request.get("active", true).asBool();
+    const auto now = RoomThrottle::Clock::now();
+    auto &state = context.ephemeral_states[std::format("{}:{}", event_type, room_id)];
+    if (state.active == active && now - state.last_sent < ephemeral_debounce_interval_)
+    {
+        ephemeral_debounced_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (!ephemeral_throttle_->TryAcquire(room_id, now))
+    {
+        ephemeral_throttled_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    state = {active, now};
+
+    Json::Value event;
+    event["type"] = event_type;
+    event["room_id"] = room_id;
+    event["user_id"] = context.user_id;
+    event["active"] = active;
+    BroadcastEphemeral(room_id, std::move(event), std::format("{}:{}:{}", event_type, room_id, context.user_id));
+}
+
+void ChatSocketController::HandleSubscription(const WebSocketConnectionPtr &ws_conn, const Json::Value &request)
+{
+    const auto &room_ids = request["room_ids"];
+    const auto &background = request["background"];
+    if (!room_ids.isArray() || !std::ranges::all_of(room_ids, &Json::Value::isInt) ||
+        (!background.isNull() && background != "bump" && background != "none"))
+    {
+        SendError(ws_conn, "room_ids must be an array of room ids and background either \"bump\" or \"none\"");
+        return;
+    }
+
+    auto &context = ws_conn->getContextRef<ClientContext>();
+    if (!context.subscribed_room_ids)
+    {
+        // Leaving the implicit subscribe-all mode: start from an explicit set.
+        context.subscribed_room_ids.emplace();
+        if (request["type"] == "unsubscribe")
+        {
+            context.subscribed_room_ids->insert(context.room_ids.begin(), context.room_ids.end());
+        }
+    }
+    for (const auto &room_id : room_ids)
+    {
+        if (request["type"] == "subscribe")
+        {
+            context.subscribed_room_ids->insert(room_id.asInt());
+        }
+        else
+        {
+            context.subscribed_room_ids->erase(room_id.asInt());
+        }
+    }
+    if (!background.isNull())
+    {
+        context.bump_unsubscribed_rooms = background == "bump";
+    }
+}
+
+ChatSocketController::Heartbeat &ChatSocketController::HeartbeatOf(trantor::EventLoop *const loop)
+{
+    std::lock_guard lock(heartbeats_mutex_);
+    auto &heartbeat = heartbeats_[loop];
+    if (!heartbeat)
+    {
+        heartbeat = std::make_unique<Heartbeat>(kHeartbeatWheelSlots);
+        loop->runEvery(heartbeat_tick_, [this, heartbeat = heartbeat.get()] { TickHeartbeat(*heartbeat); });
+    }
+    return *heartbeat;
+}
+
+void ChatSocketController::TickHeartbeat(Heartbeat &heartbeat)
+{
+    heartbeat.now = std::chrono::system_clock::now();
+    heartbeat.wheel.Tick([this, &heartbeat](const std::weak_ptr<WebSocketConnection> &weak_conn) -> uint64_t {
+        const auto ws_conn = weak_conn.lock();
+        if (!ws_conn || ws_conn->disconnected())
+        {
+            return 0;
+        }
+        return VisitConnection(heartbeat, ws_conn);
+    });
+}
+
+uint64_t ChatSocketController::VisitConnection(Heartbeat &heartbeat, const WebSocketConnectionPtr &ws_conn)
+{
+    auto &context = ws_conn->getContextRef<ClientContext>();
+    const auto current_tick = heartbeat.wheel.CurrentTick();
+    const auto idle_ticks = current_tick - context.last_activity_tick;
+    if (idle_ticks >= dead_peer_ticks_)
+    {
+        heartbeat_dead_peers_.fetch_add(1, std::memory_order_relaxed);
+        ws_conn->forceClose();
+        return 0;
+    }
+    if (context.last_activity_tick > context.last_presence_tick &&
+        current_tick - context.last_presence_tick >= presence_interval_ticks_)
+    {
+        context.last_presence_tick = current_tick;
+        app().getPlugin<PresenceTracker>()->Touch(context.user_id, heartbeat.now, context.room_ids);
+    }
+    // Entries past the debounce interval no longer suppress anything, so a connection only keeps the states it sent
+    // recently.
+    if (!context.ephemeral_states.empty())
+    {
+        std::erase_if(context.ephemeral_states, [this, now = RoomThrottle::Clock::now()](const auto &entry) {
+            return now - entry.second.last_sent >= ephemeral_debounce_interval_;
+        });
+    }
+    if (idle_ticks >= ping_interval_ticks_)
+    {
+        heartbeat_pings_.fetch_add(1, std::memory_order_relaxed);
+        SendDirect(ws_conn, "", WebSocketMessageType::Ping);
+        return ping_interval_ticks_;
+    }
+    return ping_interval_ticks_ - idle_ticks;
+}
+
+void ChatSocketController::handleNewConnection(const HttpRequestPtr &req, const WebSocketConnectionPtr &wsConnPtr)
+{
+    const auto &token = req->getAttributes()->get<TokenContext>("token");
+    const auto user_id = token.user_id;
+    const auto &refresh_token_id = token.refresh_id;
+    auto &heartbeat = HeartbeatOf(trantor::EventLoop::getEventLoopOfCurrentThread());
+    const auto current_tick = heartbeat.wheel.CurrentTick();
+    app().getPlugin<PresenceTracker>()->Touch(user_id, heartbeat.now);
+    const auto wire_format = req->getParameter("encoding") == "msgpack" ? WireFormat::kMsgPack : WireFormat::kJson;
+    const auto tcp_conn = req->getConnectionPtr().lock();
+    // Bytes already written, such as the upgrade response, never count towards the unsent window.
+    const std::size_t bytes_on_wire = tcp_conn ? tcp_conn->bytesSent() : 0;
+    wsConnPtr->setContext(std::make_shared<ClientContext>(
+        ClientContext{user_id, refresh_token_id, {}, wire_format, tcp_conn,
+                      std::make_shared<OutboundQueue>(outbound_limits_, outbound_metrics_, bytes_on_wire),
+                      &heartbeat.wheel, current_tick, current_tick}));
+    heartbeat.wheel.Schedule(ping_interval_ticks_, wsConnPtr);
+    LoadRoomMemberships(wsConnPtr, user_id, ParseResumePoints(req->getParameter("resume")));
+
+    if (const auto old_ws_conn = websocket_connections_.Insert(user_id, refresh_token_id, wsConnPtr))
+    {
+        Json::Value message;
+        message["type"] = "disconnect";
+        message["message"] = "duplicate connection";
+        SendEvent(old_ws_conn, std::move(message));
+        old_ws_conn->forceClose();
+    }
+}
+
+void ChatSocketController::handleConnectionClosed(const WebSocketConnectionPtr &wsConnPtr)
+{
+    const auto &context = wsConnPtr->getContextRef<ClientContext>();
+    if (context.last_activity_tick > context.last_presence_tick)
+    {
+        app().getPlugin<PresenceTracker>()->Touch(context.user_id, std::chrono::system_clock::now(), context.room_ids);
+    }
+    for (const auto room_id : context.room_ids)
+    {
+        // Without a local member the room's events stop arriving here, so its history would have holes. Dropped under
+        // the room's lock: a member joining concurrently either keeps the room alive or starts from an empty history.
+        room_index_.Remove(room_id, wsConnPtr, [this, room_id] {
+            replay_buffer_->Drop(room_id);
+            ephemeral_throttle_->Drop(room_id);
+        });
+        room_relay_->RemoveLocalMember(room_id);
     }
+    websocket_connections_.Erase(context.user_id, context.refresh_token_id, wsConnPtr);
 }
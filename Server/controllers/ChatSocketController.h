@@ -1,8 +1,17 @@
 #pragma once
+#include "models/Room.h"
 #include "models/User.h"
+#include "realtime/ConnectionRegistry.h"
+#include "realtime/EncodedEvent.h"
+#include "realtime/OutboundQueue.h"
+#include "realtime/ReplayBuffer.h"
+#include "realtime/RoomIndex.h"
+#include "realtime/RoomRelay.h"
+#include "realtime/RoomThrottle.h"
+#include "realtime/TimingWheel.h"
 
 #include <drogon/WebSocketController.h>
-#include <shared_mutex>
+#include <drogon/utils/coroutine.h>
 
 namespace server::ws
 {
@@ -17,16 +26,131 @@ class ChatSocketController : public WebSocketController<ChatSocketController>,
     void handleNewMessage(const WebSocketConnectionPtr &, std::string &&, const WebSocketMessageType &) override;
     void handleNewConnection(const HttpRequestPtr &, const WebSocketConnectionPtr &) override;
     void handleConnectionClosed(const WebSocketConnectionPtr &) override;
+    // Server pushes are JSON text frames unless the client connects with ?encoding=msgpack, in which case they are
+    // MessagePack binary frames. Client frames are accepted in either encoding.
+    // A reconnecting client passes ?resume=<room_id>:<last_seq>,... to receive the room events it missed; a room whose
+    // gap is no longer held in memory gets a "resync" event instead. Replayed and live events may overlap, so clients
+    // apply events in seq order and skip the ones they already have.
+    // {"type":"typing"|"viewing","room_id":...,"active":bool} frames are ephemeral: they are never stored, repeated
+    // states are debounced per connection and room, and each node forwards a bounded number of them per room and
+    // second. Any of them may be dropped, so clients expire these indicators on their own.
+    // {"type":"subscribe"|"unsubscribe","room_ids":[...],"background":"bump"|"none"} frames select the rooms that
+    // receive full events, e.g. the ones on screen; all rooms do until the first such frame. The other rooms get a
+    // coalescible {"type":"bump","room_id":...,"seq":...} per event, or nothing with "background":"none".
+    // The server pings connections that stay silent and closes the ones that do not answer; clients need no keep-alive
+    // of their own.
     WS_PATH_LIST_BEGIN
     WS_PATH_ADD("/ws/chat", "AuthenticationCoroFilter");
     WS_PATH_LIST_END
 
+    // Encodes the event once per wire format, delivers it to every local connection of the room's members and
+    // relays it to the other nodes. A non-zero seq is attached to the event and makes it replayable.
+    void BroadcastToRoom(Room::PrimaryKeyType room_id, Json::Value event, realtime::ReplayBuffer::Sequence seq = 0);
+    // Same for an event that may be dropped under pressure; queued events with the same coalesce key replace each
+    // other.
+    void BroadcastEphemeral(Room::PrimaryKeyType room_id, Json::Value event, const std::string &coalesce_key);
+    Json::Value GetMetrics() const;
+
   private:
-    using RefreshTokenToWebSocketConn = std::unordered_map<std::string, WebSocketConnectionPtr>;
-    std::unordered_map<User::PrimaryKeyType, RefreshTokenToWebSocketConn> websocket_connections_;
-    std::shared_mutex websocket_connections_mutex_;
-    std::chrono::seconds user_online_update_interval_;
-    std::shared_ptr<nosql::RedisSubscriber> refresh_token_change_subscriber_;
+    // Frames of one event for the wire formats its recipients use. Shared by every loop delivering it.
+    struct EventFrames
+    {
+        realtime::ReplayBuffer::Sequence seq;
+        realtime::EventClass event_class;
+        std::string coalesce_key;
+        std::shared_ptr<std::string> json_frame;
+        std::shared_ptr<std::string> msgpack_frame;
+
+        const std::shared_ptr<std::string> &Frame(const realtime::WireFormat format) const
+        {
+            return format == realtime::WireFormat::kMsgPack ? msgpack_frame : json_frame;
+        }
+    };
+
+    // Events of one room and their recipients on one IO loop.
+    struct RoomDelivery
+    {
+        Room::PrimaryKeyType room_id;
+        std::vector<WebSocketConnectionPtr> recipients;
+        std::shared_ptr<const std::vector<EventFrames>> events;
+    };
+    // Everything one IO loop delivers in a single task, in event order.
+    using LoopBatches = std::unordered_map<trantor::EventLoop *, std::vector<RoomDelivery>>;
+    struct RoomEvent
+    {
+        realtime::EncodedEvent event;
+        realtime::ReplayBuffer::Sequence seq;
+        realtime::EventClass event_class{realtime::EventClass::kDurable};
+        std::string coalesce_key;
+    };
+
+    void DeliverToRoom(Room::PrimaryKeyType room_id, RoomEvent &event);
+    void DeliverRelayed(std::vector<realtime::RoomRelay::Event> relayed);
+    // Adds the recipients of events, all of room_id, to batches under a single lookup of the room. Frames are encoded
+    // once the room's lock is released.
+    void CollectDeliveries(Room::PrimaryKeyType room_id, std::span<RoomEvent> events, LoopBatches &batches);
+    void DispatchBatches(LoopBatches batches);
+    void DeliverBatch(const std::vector<RoomDelivery> &batch);
+    void Enqueue(const WebSocketConnectionPtr &ws_conn, realtime::OutboundQueue::Entry entry);
+    void DrainOutbound(const WebSocketConnectionPtr &ws_conn);
+    using ResumePoints = std::unordered_map<Room::PrimaryKeyType, realtime::ReplayBuffer::Sequence>;
+    AsyncTask LoadRoomMemberships(WebSocketConnectionPtr ws_conn, User::PrimaryKeyType user_id,
+                                  ResumePoints resume_points);
+    void ReplayRoom(const WebSocketConnectionPtr &ws_conn, Room::PrimaryKeyType room_id,
+                    realtime::ReplayBuffer::Sequence last_seq);
+    AsyncTask HandleChatMessage(WebSocketConnectionPtr ws_conn, Json::Value request);
+    void HandleEphemeralEvent(const WebSocketConnectionPtr &ws_conn, const Json::Value &request);
+    void HandleSubscription(const WebSocketConnectionPtr &ws_conn, const Json::Value &request);
+
+    using HeartbeatWheel = realtime::TimingWheel<std::weak_ptr<WebSocketConnection>>;
+    // Drives server pings, dead peer detection and presence updates of every connection of one IO loop. Only
+    // touched from that loop.
+    struct Heartbeat
+    {
+        explicit Heartbeat(const std::size_t slot_count) : wheel(slot_count)
+        {
+        }
+
+        HeartbeatWheel wheel;
+        // Coarse wall clock, refreshed once per tick rather than read on every frame.
+        std::chrono::system_clock::time_point now{std::chrono::system_clock::now()};
+    };
+    Heartbeat &HeartbeatOf(trantor::EventLoop *loop);
+    void TickHeartbeat(Heartbeat &heartbeat);
+    uint64_t VisitConnection(Heartbeat &heartbeat, const WebSocketConnectionPtr &ws_conn);
+
+    realtime::ConnectionRegistry<User::PrimaryKeyType, WebSocketConnectionPtr> websocket_connections_;
+    // Members are grouped by the IO loop owning their connection.
+    realtime::RoomIndex<Room::PrimaryKeyType, trantor::EventLoop *, WebSocketConnectionPtr> room_index_;
+    std::mutex heartbeats_mutex_;
+    std::unordered_map<trantor::EventLoop *, std::unique_ptr<Heartbeat>> heartbeats_;
+    std::chrono::milliseconds heartbeat_tick_{};
+    uint64_t ping_interval_ticks_{};
+    uint64_t dead_peer_ticks_{};
+    uint64_t presence_interval_ticks_{};
+    std::atomic<uint64_t> heartbeat_pings_{0};
+    std::atomic<uint64_t> heartbeat_dead_peers_{0};
+    realtime::OutboundQueue::Limits outbound_limits_{};
+    std::chrono::milliseconds outbound_retry_interval_{};
+    realtime::OutboundQueueMetrics outbound_metrics_;
+    struct FanoutMetrics
+    {
+        std::atomic<uint64_t> broadcasts{0};
+        std::atomic<uint64_t> deliveries{0};
+        std::atomic<uint64_t> bumps{0};
+        std::atomic<uint64_t> suppressed{0};
+        std::atomic<uint64_t> loop_dispatches{0};
+        // Frame bytes handed to recipients versus bytes actually serialized or copied to produce them.
+        std::atomic<uint64_t> bytes_delivered{0};
+        std::atomic<uint64_t> bytes_encoded{0};
+    } fanout_metrics_;
+    std::shared_ptr<nosql::RedisSubscriber> redis_subscriber_;
+    std::unique_ptr<realtime::RoomRelay> room_relay_;
+    std::unique_ptr<realtime::ReplayBuffer> replay_buffer_;
+    std::unique_ptr<realtime::RoomThrottle> ephemeral_throttle_;
+    std::chrono::milliseconds ephemeral_debounce_interval_{};
+    std::atomic<uint64_t> ephemeral_debounced_{0};
+    std::atomic<uint64_t> ephemeral_throttled_{0};
 };
 
-} // namespace server::ws
\ No newline at end of file
+} // namespace server::ws
@@ -0,0 +1,26 @@
+#include "ChatSocketController.h"
+#include "Metrics.h"
+#include "plugins/AccessTokenCache.h"
+#include "plugins/LoginThrottle.h"
+#include "plugins/PasswordHasher.h"
+#include "plugins/PresenceTracker.h"
+#include "plugins/RedisManager.h"
+#include "plugins/RevocationList.h"
+#include "plugins/UserCache.h"
+#include "utilities/HttpResponseUtil.h"
+
+using namespace server::api;
+
+Task<HttpResponsePtr> Metrics::GetAll(const HttpRequestPtr req)
+{
+    Json::Value ret;
+    ret["access_token_cache"] = app().getPlugin<AccessTokenCache>()->GetMetrics();
+    ret["login_throttle"] = app().getPlugin<LoginThrottle>()->GetMetrics();
+    ret["password_hasher"] = app().getPlugin<PasswordHasher>()->GetMetrics();
+    ret["presence"] = app().getPlugin<PresenceTracker>()->GetMetrics();
+    ret["redis"] = app().getPlugin<RedisManager>()->GetMetrics();
+    ret["revocation_list"] = app().getPlugin<RevocationList>()->GetMetrics();
+    ret["user_cache"] = app().getPlugin<UserCache>()->GetMetrics();
+    ret["websocket"] = DrClassMap::getSingleInstance<ws::ChatSocketController>()->GetMetrics();
+    co_return utilities::NewJsonResponse(std::move(ret));
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <drogon/HttpController.h>
+
+namespace server::api
+{
+using namespace drogon;
+
+class Metrics : public HttpController<Metrics>
+{
+  public:
+    METHOD_LIST_BEGIN
+    ADD_METHOD_TO(Metrics::GetAll, "/admin/metrics", "AuthenticationCoroFilter", "AdminCoroFilter", Get, Options);
+    METHOD_LIST_END
+
+    Task<HttpResponsePtr> GetAll(HttpRequestPtr req);
+};
+
+} // namespace server::api
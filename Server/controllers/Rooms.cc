@@ -1,7 +1,11 @@
 #include "Rooms.h"
 #include "models/Helper.h"
 #include "models/JoinedRoomsView.h"
+#include "models/RoomMembership.h"
 #include "models/UserRoomsWithMessagesView.h"
+#include "plugins/PresenceTracker.h"
+#include "plugins/RedisManager.h"
+#include "utilities/FormatterUtil.h"
 #include "utilities/HttpResponseUtil.h"
 
 using namespace server::api;
@@ -128,6 +132,85 @@ Task<HttpResponsePtr> Rooms::GetMultiple(const HttpRequestPtr req)
     }
 }
 
+Task<HttpResponsePtr> Rooms::GetOnlineMembers(const HttpRequestPtr req, const Room::PrimaryKeyType id)
+{
+    const auto *presence_tracker = app().getPlugin<PresenceTracker>();
+    auto within = presence_tracker->RoomOnlineWindow();
+    if (const auto it = req->getParameters().find("within"); it != req->getParameters().end())
+    {
+        try
+        {
+            within = std::min(std::chrono::seconds{std::stoull(it->second)}, within);
+        }
+        catch (...)
+        {
+            co_return utilities::NewJsonErrorResponse(k400BadRequest, "Invalid within");
+        }
+    }
+    const auto since = std::chrono::system_clock::now() - within;
+
+    std::vector<RedisManager::OnlineUser> online_users;
+    if (presence_tracker->HasRoomSets())
+    {
+        auto online_result = co_await app().getPlugin<RedisManager>()->GetRoomOnlineUsers(id, since);
+        if (!online_result)
+        {
+            LOG_ERROR << fmt::format("{}", online_result.error());
+            co_return utilities::NewJsonErrorResponse<HttpErrorCode::kCacheDatabaseError>();
+        }
+        online_users = std::move(online_result).value();
+    }
+    else
+    {
+        // No room sets: score the room's members against the global presence set.
+        std::vector<User::PrimaryKeyType> user_ids;
+        try
+        {
+            CoroMapper<RoomMembership> mapper{app().getDbClient()};
+            const auto memberships =
+                co_await mapper.findBy(Criteria{RoomMembership::Cols::_room_id, CompareOperator::EQ, id} &&
+                                       Criteria{RoomMembership::Cols::_deleted_at, CompareOperator::IsNull});
+            user_ids.reserve(memberships.size());
+            for (const auto &membership : memberships)
+            {
+                user_ids.push_back(membership.getValueOfUserId());
+            }
+        }
+        catch (const DrogonDbException &e)
+        {
+            LOG_ERROR << e.base().what();
+            co_return utilities::NewJsonErrorResponse<HttpErrorCode::kDatabaseError>();
+        }
+        const auto last_online_result = co_await app().getPlugin<RedisManager>()->GetUsersLastOnline(user_ids);
+        if (!last_online_result)
+        {
+            LOG_ERROR << fmt::format("{}", last_online_result.error());
+            co_return utilities::NewJsonErrorResponse<HttpErrorCode::kCacheDatabaseError>();
+        }
+        for (std::size_t i = 0; i < user_ids.size() && i < last_online_result->size(); ++i)
+        {
+            if (const auto &last_online = (*last_online_result)[i]; last_online && *last_online >= since)
+            {
+                online_users.emplace_back(user_ids[i], *last_online);
+            }
+        }
+        std::ranges::sort(online_users, std::ranges::greater{}, &RedisManager::OnlineUser::second);
+    }
+
+    Json::Value ret;
+    auto &data = ret["data"];
+    data.resize(0);
+    for (const auto &[user_id, last_online] : online_users)
+    {
+        Json::Value json;
+        json["user_id"] = user_id;
+        json["last_online"] = utilities::ToSeconds(last_online.time_since_epoch());
+        data.append(std::move(json));
+    }
+    ret["metadata"]["within"] = static_cast<Json::Int64>(within.count());
+    co_return HttpResponse::newHttpJsonResponse(std::move(ret));
+}
+
 Task<HttpResponsePtr> Rooms::UpdateOne(const HttpRequestPtr req, const Room::PrimaryKeyType id)
 {
  co_return utilities::NewJsonErrorResponse(k501NotImplemented);
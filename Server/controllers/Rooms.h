@@ -19,6 +19,7 @@ class Rooms : public HttpController<Rooms>, public RestfulController
 
     ADD_METHOD_TO(Rooms::GetOne, "/rooms/{id}", "AuthenticationCoroFilter", Get, Options);
     ADD_METHOD_TO(Rooms::GetMultiple, "/rooms", "AuthenticationCoroFilter", Get, Options);
+    ADD_METHOD_TO(Rooms::GetOnlineMembers, "/rooms/{id}/online", "AuthenticationCoroFilter", Get, Options);
 
     // ADD_METHOD_TO(Rooms::UpdateOne, "/rooms/{id}", "AuthenticationCoroFilter", Put, Options);
 
@@ -32,6 +33,8 @@ class Rooms : public HttpController<Rooms>, public RestfulController
     Task<HttpResponsePtr> CreateOne(HttpRequestPtr req);
     Task<HttpResponsePtr> GetOne(HttpRequestPtr req, Room::PrimaryKeyType id);
     Task<HttpResponsePtr> GetMultiple(HttpRequestPtr req);
+    // Members online within the last ?within= seconds (default and maximum: PresenceTracker's room_online_window).
+    Task<HttpResponsePtr> GetOnlineMembers(HttpRequestPtr req, Room::PrimaryKeyType id);
     Task<HttpResponsePtr> UpdateOne(HttpRequestPtr req, Room::PrimaryKeyType id);
     Task<HttpResponsePtr> DeleteOne(HttpRequestPtr req, Room::PrimaryKeyType id);
     Task<HttpResponsePtr> GetUserRooms(HttpRequestPtr req, User::PrimaryKeyType id);
@@ -36,11 +36,16 @@ Task<HttpResponsePtr> Users::CreateOne(const HttpRequestPtr req)
     }
 
     User user{*json_ptr};
-    if (auto password_hash_result = app().getPlugin<PasswordHasher>()->HashPassword(user.getValueOfPassword());
+    if (auto password_hash_result =
+            co_await app().getPlugin<PasswordHasher>()->HashPasswordAsync(user.getValueOfPassword());
         !password_hash_result)
     {
-        LOG_ERROR << fmt::format("{}", password_hash_result.error());
-        co_return utilities::NewJsonErrorResponse<HttpErrorCode::kInternalServerError>(password_hash_result.error());
+        if (const auto *e = std::get_if<Botan::Exception>(&password_hash_result.error()))
+        {
+            LOG_ERROR << fmt::format("{}", *e);
+            co_return utilities::NewJsonErrorResponse<HttpErrorCode::kInternalServerError>(*e);
+        }
+        co_return utilities::NewJsonErrorResponse<HttpErrorCode::kServiceUnavailableError>();
     }
     else
     {
@@ -5,8 +5,10 @@
  */
 
 #include "AuthenticationCoroFilter.h"
+#include "plugins/AccessTokenCache.h"
 #include "plugins/JwtTokenManager.h"
 #include "plugins/RedisManager.h"
+#include "plugins/RevocationList.h"
 #include "utilities/HttpResponseUtil.h"
 
 #include <drogon/drogon.h>
@@ -18,30 +20,53 @@ using namespace drogon::nosql;
 using namespace drogon_model::postgres;
 using namespace server;
 
+namespace
+{
+// "token" holds the whole decoded context; the single claims stay available for the existing consumers.
+void InsertAttributes(const HttpRequestPtr &req, const TokenContext &context)
+{
+    req->getAttributes()->insert("id", context.user_id);
+    req->getAttributes()->insert("role", context.role);
+    req->getAttributes()->insert("refresh_id", context.refresh_id);
+    req->getAttributes()->insert("token", context);
+}
+} // namespace
+
 Task<HttpResponsePtr> AuthenticationCoroFilter::doFilter(const HttpRequestPtr &req)
 {
     if (auto &auth_header = req->getHeader("Authorization"); auth_header.starts_with("Bearer "))
     {
         const auto token = auth_header.substr(7);
+        auto *const token_cache = app().getPlugin<AccessTokenCache>();
+        if (const auto context = token_cache->Find(token))
+        {
+            InsertAttributes(req, *context);
+            co_return nullptr;
+        }
+
+        const auto check_start = std::chrono::steady_clock::now();
         if (auto validation_result = app().getPlugin<JwtTokenManager>()->ValidateToken(token, true); validation_result)
         {
-            if (const auto token_exists_result = co_await app().getPlugin<RedisManager>()->HasAccessToken(token); token_exists_result)
+            switch (app().getPlugin<RevocationList>()->Check(*validation_result))
+            {
+            case RevocationList::Verdict::kValid:
+                InsertAttributes(req, *validation_result);
+                token_cache->Insert(token, std::move(validation_result).value(), check_start);
+                co_return nullptr;
+            case RevocationList::Verdict::kRevoked:
+                co_return utilities::NewJsonErrorResponse<HttpErrorCode::kInvalidAccessTokenError>();
+            case RevocationList::Verdict::kUnknown:
+                break;
+            }
+
+            if (const auto token_exists_result =
+                    co_await app().getPlugin<RedisManager>()->HasAccessToken(*validation_result);
+                token_exists_result)
             {
                 if (*token_exists_result)
                 {
-                    const auto decoded = jwt::decode(token);
-                    try
-                    {
-                        const User::PrimaryKeyType user_id = std::stoi(decoded.get_subject());
-                        req->getAttributes()->insert("id", user_id);
-                    }
-                    catch (const std::exception &e)
-                    {
-                        LOG_ERROR << e.what();
-                        co_return utilities::NewJsonErrorResponse<HttpErrorCode::kInternalServerError>();
-                    }
-                    req->getAttributes()->insert("role", decoded.get_payload_claim("role").as_string());
-                    req->getAttributes()->insert("refresh_id", decoded.get_payload_claim("refresh_id").as_string());
+                    InsertAttributes(req, *validation_result);
+                    token_cache->Insert(token, std::move(validation_result).value(), check_start);
                     co_return nullptr;
                 }
             }
@@ -57,4 +82,4 @@ Task<HttpResponsePtr> AuthenticationCoroFilter::doFilter(const HttpRequestPtr &r
     }
 
     co_return utilities::NewJsonErrorResponse<HttpErrorCode::kInvalidAccessTokenError>();
-}
\ No newline at end of file
+}
@@ -0,0 +1,156 @@
+/**
+ *
+ *  AccessTokenCache.cc
+ *
+ */
+
+#include "AccessTokenCache.h"
+
+#include <drogon/HttpAppFramework.h>
+
+using namespace drogon;
+
+void AccessTokenCache::initAndStart(const Json::Value &config)
+{
+    const auto capacity = config.get("capacity", 100000).asUInt64();
+    ttl_ = std::chrono::seconds{config.get("ttl_seconds", 300).asUInt()};
+    shards_.reserve(kShardCount);
+    for (std::size_t i = 0; i < kShardCount; ++i)
+    {
+        shards_.push_back(std::make_unique<Shard>((capacity + kShardCount - 1) / kShardCount));
+    }
+
+    const auto redis_client = app().getRedisClient();
+    // K: keyspace channels, $: string commands (a new access token is a SET), x: expirations, g: DEL.
+    // Redis cannot scope notifications to a key prefix, so every string write in the database is matched against the
+    // subscribers' patterns; only refresh_token:* and user:* events are delivered to this server.
+    if (const auto events = config.get("notify_keyspace_events", "K$xg").asString(); !events.empty())
+    {
+        try
+        {
+            const auto success = redis_client->execCommandSync<bool>(
+                [](const nosql::RedisResult &result) { return result.asString() == "OK"; },
+                "CONFIG SET notify-keyspace-events %s", events.c_str());
+            ASSERT(success, "Failed to set notify-keyspace-events");
+        }
+        catch (const nosql::RedisException &e)
+        {
+            // Managed servers may refuse CONFIG; notifications must then be enabled in the server configuration.
+            LOG_ERROR << "Failed to set notify-keyspace-events: " << e.what();
+        }
+    }
+    subscriber_ = redis_client->newSubscriber();
+    const auto redis_db_index = app().getCustomConfig()["redis_clients"].get("db_index", 0).asUInt();
+    subscriber_->psubscribe(std::format("__keyspace@{}__:refresh_token:*", redis_db_index),
+                            [this](const std::string &channel, const std::string &) {
+                                constexpr std::string_view kPrefix = "refresh_token:";
+                                if (const auto pos = channel.find(kPrefix); pos != std::string::npos)
+                                {
+                                    Invalidate(channel.substr(pos + kPrefix.size()));
+                                }
+                            });
+}
+
+void AccessTokenCache::shutdown()
+{
+    subscriber_.reset();
+}
+
+std::optional<TokenContext> AccessTokenCache::Find(const std::string &token)
+{
+    auto &shard = ShardFor(token);
+    {
+        std::lock_guard lock(shard.mutex);
+        const auto *entry =
+            shard.tokens.Find(token, std::chrono::steady_clock::now(),
+                              [&shard](const std::string &expired_token, const Entry &expired) {
+                                  Unlink(shard, expired.refresh_key, expired_token);
+                              });
+        if (entry)
+        {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return entry->context;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+}
+
+void AccessTokenCache::Insert(const std::string &token, TokenContext context,
+                              const std::chrono::steady_clock::time_point check_start)
+{
+    const auto lifetime = std::min<std::chrono::system_clock::duration>(
+        context.expires_at - std::chrono::system_clock::now(), ttl_);
+    if (lifetime <= std::chrono::system_clock::duration::zero())
+    {
+        return;
+    }
+    auto refresh_key = std::format("{}:{}", context.user_id, context.refresh_id);
+    auto &shard = ShardFor(token);
+    std::lock_guard lock(shard.mutex);
+    // Checked under the shard lock, under which Invalidate() records the refresh key before sweeping the shard, so
+    // either the token is refused here or it is already in the shard when the invalidation sweeps it.
+    const auto now = std::chrono::steady_clock::now();
+    if (!shard.invalidations.MayCache(refresh_key, check_start, now))
+    {
+        return;
+    }
+    const auto expires_at_steady = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(lifetime);
+    shard.tokens_by_refresh_key[refresh_key].insert(token);
+    if (auto evicted = shard.tokens.Insert(token, Entry{std::move(context), std::move(refresh_key)}, expires_at_steady))
+    {
+        Unlink(shard, evicted->second.refresh_key, evicted->first);
+    }
+    insertions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+Json::Value AccessTokenCache::GetMetrics() const
+{
+    Json::Value metrics;
+    metrics["hits"] = hits_.load(std::memory_order_relaxed);
+    metrics["misses"] = misses_.load(std::memory_order_relaxed);
+    metrics["insertions"] = insertions_.load(std::memory_order_relaxed);
+    metrics["invalidations"] = invalidations_.load(std::memory_order_relaxed);
+    return metrics;
+}
+
+AccessTokenCache::Shard &AccessTokenCache::ShardFor(const std::string &token)
+{
+    return *shards_[std::hash<std::string>{}(token) % kShardCount];
+}
+
+void AccessTokenCache::Invalidate(const std::string &refresh_key)
+{
+    invalidations_.fetch_add(1, std::memory_order_relaxed);
+    const auto now = std::chrono::steady_clock::now();
+    // Tokens are sharded by their own hash, so the tokens of one refresh token may live in any shard.
+    for (const auto &shard : shards_)
+    {
+        std::lock_guard lock(shard->mutex);
+        shard->invalidations.Record(refresh_key, now);
+        const auto it = shard->tokens_by_refresh_key.find(refresh_key);
+        if (it == shard->tokens_by_refresh_key.end())
+        {
+            continue;
+        }
+        for (const auto &token : it->second)
+        {
+            shard->tokens.Erase(token);
+        }
+        shard->tokens_by_refresh_key.erase(it);
+    }
+}
+
+void AccessTokenCache::Unlink(Shard &shard, const std::string &refresh_key, const std::string &token)
+{
+    const auto it = shard.tokens_by_refresh_key.find(refresh_key);
+    if (it == shard.tokens_by_refresh_key.end())
+    {
+        return;
+    }
+    it->second.erase(token);
+    if (it->second.empty())
+    {
+        shard.tokens_by_refresh_key.erase(it);
+    }
+}
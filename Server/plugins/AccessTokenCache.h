@@ -0,0 +1,78 @@
+/**
+ *
+ *  AccessTokenCache.h
+ *
+ */
+
+#pragma once
+
+#include "plugins/JwtTokenManager.h"
+#include "utilities/LruCache.h"
+#include "utilities/RecentInvalidations.h"
+
+#include <atomic>
+#include <drogon/nosql/RedisSubscriber.h>
+#include <drogon/plugins/Plugin.h>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * In-process cache of access tokens that passed both signature validation and the Redis refresh token check.
+ * A hit costs a hash lookup instead of an HMAC and a Redis round trip. Entries are keyed by the raw token, so a forged
+ * token reusing a cached token id can never hit, and expire with the token or after ttl_seconds, whichever is first.
+ * Every change of a refresh_token:* key (new access token, logout, expiry) is delivered by keyspace notification and
+ * drops the tokens issued for it, so revocation stays as fast as the notification.
+ */
+class AccessTokenCache : public drogon::Plugin<AccessTokenCache>
+{
+  public:
+    void initAndStart(const Json::Value &config) override;
+    void shutdown() override;
+
+    std::optional<TokenContext> Find(const std::string &token);
+    // check_start is when the token's check against Redis began: Insert() ignores the token if its refresh token
+    // changed since, as the check may have raced with that change.
+    void Insert(const std::string &token, TokenContext context, std::chrono::steady_clock::time_point check_start);
+    Json::Value GetMetrics() const;
+
+  private:
+    static constexpr std::size_t kShardCount = 16;
+    // How long an invalidation is remembered; checks taking longer are not cached.
+    static constexpr std::chrono::seconds kInvalidationWindow{10};
+
+    struct Entry
+    {
+        TokenContext context;
+        // "<user_id>:<refresh_id>", the suffix of the refresh token key.
+        std::string refresh_key;
+    };
+
+    struct alignas(64) Shard
+    {
+        explicit Shard(const std::size_t capacity) : tokens(capacity), invalidations(kInvalidationWindow)
+        {
+        }
+
+        std::mutex mutex;
+        server::utilities::LruCache<std::string, Entry> tokens;
+        // Kept in step with tokens: a token leaves its refresh key's set whenever it leaves the LRU.
+        std::unordered_map<std::string, std::unordered_set<std::string>> tokens_by_refresh_key;
+        // Refresh keys, recorded in every shard along with the sweep of their tokens.
+        server::utilities::RecentInvalidations<std::string> invalidations;
+    };
+
+    Shard &ShardFor(const std::string &token);
+    void Invalidate(const std::string &refresh_key);
+    static void Unlink(Shard &shard, const std::string &refresh_key, const std::string &token);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::chrono::seconds ttl_{};
+    std::shared_ptr<drogon::nosql::RedisSubscriber> subscriber_;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> insertions_{0};
+    std::atomic<uint64_t> invalidations_{0};
+};
@@ -5,109 +5,145 @@
  */
 
 #include "JwtTokenManager.h"
+#include "utilities/UuidValidator.h"
+
+#include <charconv>
 
 using namespace drogon;
 
+namespace
+{
+void VerifyUuidClaim(const jwt::verify_ops::verify_context<jwt::traits::kazuho_picojson> &ctx, std::error_code &ec)
+{
+    const auto jti = ctx.get_claim(false, ec);
+    if (ec)
+    {
+        return;
+    }
+    if (jti.get_type() != jwt::json::type::string)
+    {
+        ec = jwt::error::token_verification_error::claim_type_missmatch;
+        return;
+    }
+    if (!server::utilities::IsUuid(jti.as_string()))
+    {
+        ec = jwt::error::token_verification_error::claim_value_missmatch;
+    }
+}
+
+void VerifyUsernameClaim(const jwt::verify_ops::verify_context<jwt::traits::kazuho_picojson> &ctx,
+                         std::error_code &ec)
+{
+    const auto username = ctx.get_claim(false, ec);
+    if (ec)
+    {
+        return;
+    }
+    if (username.get_type() != jwt::json::type::string)
+    {
+        ec = jwt::error::token_verification_error::claim_type_missmatch;
+        return;
+    }
+    if (username.as_string().empty())
+    {
+        ec = jwt::error::token_verification_error::claim_value_missmatch;
+    }
+}
+
+void VerifyRoleClaim(const jwt::verify_ops::verify_context<jwt::traits::kazuho_picojson> &ctx, std::error_code &ec)
+{
+    const auto role = ctx.get_claim(false, ec);
+    if (ec)
+    {
+        return;
+    }
+    if (role.get_type() != jwt::json::type::string)
+    {
+        ec = jwt::error::token_verification_error::claim_type_missmatch;
+        return;
+    }
+
+    static constexpr auto roles = {"admin", "user"};
+    if (!std::ranges::contains(roles, role.as_string()))
+    {
+        ec = jwt::error::token_verification_error::claim_value_missmatch;
+    }
+}
+} // namespace
+
 void JwtTokenManager::initAndStart(const Json::Value &config)
 {
     issuer_ = config.get("issuer", "server").asString();
     secret_ = config.get("secret", "secret").asString();
     access_token_expiry_ = std::chrono::seconds{config.get("access_token_expiry", 60 * 60).asUInt()};
     refresh_token_expiry_ = std::chrono::seconds{config.get("refresh_token_expiry", 30 * 24 * 60 * 60).asUInt()};
+
+    // Built once: verifiers are only read afterwards, so they are shared by every IO thread.
+    algorithm_.emplace(secret_);
+    refresh_verifier_.emplace(jwt::verify()
+                                  .allow_algorithm(*algorithm_)
+                                  .with_issuer(issuer_)
+                                  .with_type("refresh")
+                                  .with_claim("jti", VerifyUuidClaim));
+    access_verifier_.emplace(jwt::verify()
+                                 .allow_algorithm(*algorithm_)
+                                 .with_issuer(issuer_)
+                                 .with_type("access")
+                                 .with_claim("jti", VerifyUuidClaim)
+                                 .with_claim("refresh_id", VerifyUuidClaim)
+                                 .with_claim("username", VerifyUsernameClaim)
+                                 .with_claim("role", VerifyRoleClaim));
 }
 
 void JwtTokenManager::shutdown() 
 {
 }
 
-std::expected<void, JwtTokenManager::ValidateError> JwtTokenManager::ValidateToken(
+std::expected<TokenContext, JwtTokenManager::ValidateError> JwtTokenManager::ValidateToken(
     const std::string &token, const bool is_access,
     const std::optional<std::string> &ref_token_id_opt) const
 {
     try
     {
-        const auto uuid_verification_fn = [](const auto &ctx, std::error_code &ec) {
-            const auto jti = ctx.get_claim(false, ec);
-            if (ec)
-            {
-                return;
-            }
-            if (jti.get_type() != jwt::json::type::string)
-            {
-                ec = jwt::error::token_verification_error::claim_type_missmatch;
-                return;
-            }
-            static const std::regex reg("^[0-9a-f]{8}-[0-9a-f]{4}-[0-5][0-9a-f]{3}-[089ab][0-9a-f]{3}-[0-9a-f]{12}$",
-                                        std::regex_constants::icase);
-            if (!std::regex_match(jti.as_string(), reg))
-            {
-                ec = jwt::error::token_verification_error::claim_value_missmatch;
-            }
-        };
-
-        const auto username_verification_fn = [](const auto &ctx, std::error_code &ec) {
-            const auto username = ctx.get_claim(false, ec);
-            if (ec)
-            {
-                return;
-            }
-            if (username.get_type() != jwt::json::type::string)
-            {
-                ec = jwt::error::token_verification_error::claim_type_missmatch;
-                return;
-            }
-            if (username.as_string().empty())
-            {
-                ec = jwt::error::token_verification_error::claim_value_missmatch;
-            }
-        };
-
-        const auto role_verification_fn = [](const auto &ctx, std::error_code &ec) {
-            const auto role = ctx.get_claim(false, ec);
-            if (ec)
-            {
-                return;
-            }
-            if (role.get_type() != jwt::json::type::string)
-            {
-                ec = jwt::error::token_verification_error::claim_type_missmatch;
-                return;
-            }
-
-            static constexpr auto roles = {"admin", "user"};
-            if (!std::ranges::contains(roles, role.as_string()))
-            {
-                ec = jwt::error::token_verification_error::claim_value_missmatch;
-            }
-        };
-
         const auto decoded = jwt::decode(token);
-        auto verifier = jwt::verify()
-                            .allow_algorithm(jwt::algorithm::hs256{secret_})
-                            .with_issuer(issuer_)
-                            .with_type(is_access ? "access" : "refresh")
-                            .with_claim("jti", uuid_verification_fn);
-        if (is_access)
+        std::error_code ec;
+        if (is_access && ref_token_id_opt)
         {
-            if (ref_token_id_opt)
-            {
-                verifier.with_claim("refresh_id", jwt::claim(*ref_token_id_opt));
-            }
-            else
-            {
-                verifier.with_claim("refresh_id", uuid_verification_fn);
-            }
-            verifier.with_claim("username", username_verification_fn).with_claim("role", role_verification_fn);
+            // Rare enough to pay for a copy of the prebuilt verifier.
+            auto verifier = *access_verifier_;
+            verifier.with_claim("refresh_id", jwt::claim(*ref_token_id_opt));
+            verifier.verify(decoded, ec);
+        }
+        else
+        {
+            (is_access ? *access_verifier_ : *refresh_verifier_).verify(decoded, ec);
         }
-
-        std::error_code ec;
-        verifier.verify(decoded, ec);
 
         if (ec)
         {
             return std::unexpected(ec);
         }
-        return {};
+
+        TokenContext context;
+        const auto subject = decoded.get_subject();
+        if (const auto [ptr, parse_ec] = std::from_chars(subject.data(), subject.data() + subject.size(),
+                                                         context.user_id);
+            parse_ec != std::errc{} || ptr != subject.data() + subject.size())
+        {
+            return std::unexpected(std::error_code(jwt::error::token_verification_error::claim_value_missmatch));
+        }
+        context.token_id = decoded.get_id();
+        if (decoded.has_issued_at())
+        {
+            context.issued_at = decoded.get_issued_at();
+        }
+        context.expires_at = decoded.get_expires_at();
+        if (is_access)
+        {
+            context.refresh_id = decoded.get_payload_claim("refresh_id").as_string();
+            context.role = decoded.get_payload_claim("role").as_string();
+        }
+        return context;
     }
     catch (const std::invalid_argument &e)
     {
@@ -123,32 +159,56 @@ std::expected<void, JwtTokenManager::ValidateError> JwtTokenManager::ValidateTok
     }
 }
 
-std::string JwtTokenManager::GenerateRefreshToken(const drogon_model::postgres::User &user) const
+IssuedToken JwtTokenManager::GenerateRefreshToken(const drogon_model::postgres::User &user) const
 {
-    const auto uuid = utils::getUuid();
-    return jwt::create()
-        .set_issuer(issuer_)
-        .set_id(uuid)
-        .set_subject(std::to_string(user.getValueOfId()))
-        .set_type("refresh")
-        .set_expires_at(std::chrono::system_clock::now() + refresh_token_expiry_)
-        .sign(jwt::algorithm::hs256{secret_});
+    IssuedToken issued;
+    issued.context.token_id = utils::getUuid();
+    issued.context.user_id = user.getValueOfId();
+    issued.context.issued_at = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+    issued.context.expires_at = issued.context.issued_at + refresh_token_expiry_;
+    issued.token = jwt::create()
+                       .set_issuer(issuer_)
+                       .set_id(issued.context.token_id)
+                       .set_subject(std::to_string(issued.context.user_id))
+                       .set_type("refresh")
+                       .set_issued_at(issued.context.issued_at)
+                       .set_expires_at(issued.context.expires_at)
+                       .sign(*algorithm_);
+    return issued;
 }
 
-std::string JwtTokenManager::GenerateAccessToken(const std::string &refresh_token,
+IssuedToken JwtTokenManager::GenerateAccessToken(const TokenContext &refresh,
                                                  const drogon_model::postgres::User &user) const
 {
-    const auto uuid = utils::getUuid();
-    const auto decoded = jwt::decode(refresh_token);
-    const auto refresh_id = decoded.get_id();
-    return jwt::create()
-        .set_issuer(issuer_)
-        .set_id(uuid)
-        .set_subject(decoded.get_subject())
-        .set_payload_claim("refresh_id", jwt::claim(refresh_id))
-        .set_payload_claim("username", jwt::claim(user.getValueOfUsername()))
-        .set_payload_claim("role", jwt::claim(user.getValueOfRole()))
-        .set_type("access")
-        .set_expires_at(std::chrono::system_clock::now() + access_token_expiry_)
-        .sign(jwt::algorithm::hs256{secret_});
-}
\ No newline at end of file
+    return GenerateAccessToken(refresh, user, utils::getUuid(), NextAccessTokenExpiry());
+}
+
+IssuedToken JwtTokenManager::GenerateAccessToken(const TokenContext &refresh, const drogon_model::postgres::User &user,
+                                                 std::string token_id,
+                                                 const std::chrono::system_clock::time_point expires_at) const
+{
+    IssuedToken issued;
+    issued.context.token_id = std::move(token_id);
+    issued.context.user_id = refresh.user_id;
+    issued.context.issued_at = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+    issued.context.expires_at = expires_at;
+    issued.context.refresh_id = refresh.token_id;
+    issued.context.role = user.getValueOfRole();
+    issued.token = jwt::create()
+                       .set_issuer(issuer_)
+                       .set_id(issued.context.token_id)
+                       .set_subject(std::to_string(issued.context.user_id))
+                       .set_payload_claim("refresh_id", jwt::claim(issued.context.refresh_id))
+                       .set_payload_claim("username", jwt::claim(user.getValueOfUsername()))
+                       .set_payload_claim("role", jwt::claim(issued.context.role))
+                       .set_type("access")
+                       .set_issued_at(issued.context.issued_at)
+                       .set_expires_at(issued.context.expires_at)
+                       .sign(*algorithm_);
+    return issued;
+}
+
+std::chrono::system_clock::time_point JwtTokenManager::NextAccessTokenExpiry() const
+{
+    return std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now() + access_token_expiry_);
+}
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "models/User.h"
+#include "utilities/HmacSha256.h"
 
 #include <drogon/plugins/Plugin.h>
 #include <jwt-cpp/jwt.h>
@@ -20,6 +21,26 @@
  * In WebSocketController, subscribe to Redis key event notifications for key expiration and deletion. If the refresh token ID is deleted, force-close the corresponding WebSocket connection.
  */
 
+// Claims of a token, decoded once by ValidateToken or captured when the token is issued. The authentication filter
+// stores the access token's context in the request attributes under "token".
+struct TokenContext
+{
+    std::string token_id;
+    drogon_model::postgres::User::PrimaryKeyType user_id{};
+    // The epoch for tokens issued before the iat claim was added.
+    std::chrono::system_clock::time_point issued_at;
+    std::chrono::system_clock::time_point expires_at;
+    // Access tokens only.
+    std::string refresh_id;
+    std::string role;
+};
+
+struct IssuedToken
+{
+    std::string token;
+    TokenContext context;
+};
+
 class JwtTokenManager : public virtual drogon::Plugin<JwtTokenManager>
 {
     using User = drogon_model::postgres::User;
@@ -30,17 +51,26 @@ class JwtTokenManager : public virtual drogon::Plugin<JwtTokenManager>
     using DecodeType = decltype(jwt::decode(std::declval<std::string>()));
     using ValidateError = std::variant<std::error_code, std::invalid_argument, std::runtime_error>;
 
-    std::expected<void, ValidateError> ValidateToken(
+    std::expected<TokenContext, ValidateError> ValidateToken(
         const std::string &token, bool is_access = false,
         const std::optional<std::string> &ref_token_id_opt = std::nullopt) const;
-    std::string GenerateRefreshToken(const User &user) const;
-    std::string GenerateAccessToken(const std::string &refresh_token,
-                                    const User &user) const;
+    IssuedToken GenerateRefreshToken(const User &user) const;
+    IssuedToken GenerateAccessToken(const TokenContext &refresh, const User &user) const;
+    // For callers that must store the token id before the token is signed.
+    IssuedToken GenerateAccessToken(const TokenContext &refresh, const User &user, std::string token_id,
+                                    std::chrono::system_clock::time_point expires_at) const;
+    // Expiry of an access token issued now, truncated to the second like the exp claim.
+    std::chrono::system_clock::time_point NextAccessTokenExpiry() const;
 
     private:
     std::string issuer_;
     std::string secret_;
     std::chrono::seconds access_token_expiry_{};
     std::chrono::seconds refresh_token_expiry_{};
+
+    using Verifier = decltype(jwt::verify());
+    std::optional<server::utilities::HmacSha256> algorithm_;
+    std::optional<Verifier> access_verifier_;
+    std::optional<Verifier> refresh_verifier_;
 };
 
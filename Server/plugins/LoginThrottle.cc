@@ -0,0 +1,144 @@
+/**
+ *
+ *  LoginThrottle.cc
+ *
+ */
+
+#include "LoginThrottle.h"
+#include "plugins/RedisManager.h"
+#include "utilities/FormatterUtil.h"
+
+#include <drogon/HttpAppFramework.h>
+
+using namespace drogon;
+
+namespace
+{
+std::string UsernameKey(const std::string &username)
+{
+    return "user:" + username;
+}
+
+std::string AddressKey(const std::string &address)
+{
+    return "ip:" + address;
+}
+} // namespace
+
+void LoginThrottle::initAndStart(const Json::Value &config)
+{
+    max_username_failures_ = config.get("max_failures_per_username", 5).asUInt64();
+    max_address_failures_ = config.get("max_failures_per_address", 50).asUInt64();
+    window_ = std::chrono::seconds{config.get("window_seconds", 900).asUInt()};
+    failures_ = server::utilities::LruCache<std::string, uint64_t>(config.get("capacity", 100000).asUInt64());
+}
+
+void LoginThrottle::shutdown()
+{
+}
+
+Task<bool> LoginThrottle::Allow(const std::string &username, const std::string &address)
+{
+    if (OverLimit(username, address))
+    {
+        throttled_locally_.fetch_add(1, std::memory_order_relaxed);
+        co_return false;
+    }
+
+    // Failures counted by other nodes.
+    if (const auto failures = co_await app().getPlugin<RedisManager>()->GetLoginFailures(username, address);
+        failures)
+    {
+        Mirror(username, failures->username, address, failures->address);
+        if (failures->username >= max_username_failures_ || failures->address >= max_address_failures_)
+        {
+            throttled_.fetch_add(1, std::memory_order_relaxed);
+            co_return false;
+        }
+    }
+    else
+    {
+        LOG_ERROR << fmt::format("{}", failures.error());
+    }
+    allowed_.fetch_add(1, std::memory_order_relaxed);
+    co_return true;
+}
+
+void LoginThrottle::RecordFailure(const std::string &username, const std::string &address)
+{
+    failures_recorded_.fetch_add(1, std::memory_order_relaxed);
+    {
+        // Counted locally right away, so that this node throttles even without Redis.
+        std::lock_guard lock(mutex_);
+        const auto now = std::chrono::steady_clock::now();
+        for (const auto &key : {UsernameKey(username), AddressKey(address)})
+        {
+            const auto *const count = failures_.Find(key, now);
+            failures_.Insert(key, count == nullptr ? 1 : *count + 1, now + window_);
+        }
+    }
+    IncrementAsync(username, address);
+}
+
+void LoginThrottle::RecordSuccess(const std::string &username)
+{
+    {
+        std::lock_guard lock(mutex_);
+        failures_.Erase(UsernameKey(username));
+    }
+    app().getPlugin<RedisManager>()->ClearLoginFailuresAsync(username);
+}
+
+Json::Value LoginThrottle::GetMetrics() const
+{
+    Json::Value metrics;
+    metrics["allowed"] = allowed_.load(std::memory_order_relaxed);
+    metrics["throttled_locally"] = throttled_locally_.load(std::memory_order_relaxed);
+    metrics["throttled"] = throttled_.load(std::memory_order_relaxed);
+    metrics["failures"] = failures_recorded_.load(std::memory_order_relaxed);
+    return metrics;
+}
+
+bool LoginThrottle::OverLimit(const std::string &username, const std::string &address)
+{
+    std::lock_guard lock(mutex_);
+    const auto now = std::chrono::steady_clock::now();
+    const auto *const username_failures = failures_.Find(UsernameKey(username), now);
+    if (username_failures != nullptr && *username_failures >= max_username_failures_)
+    {
+        return true;
+    }
+    const auto *const address_failures = failures_.Find(AddressKey(address), now);
+    return address_failures != nullptr && *address_failures >= max_address_failures_;
+}
+
+void LoginThrottle::Mirror(const std::string &username, const uint64_t username_failures, const std::string &address,
+                           const uint64_t address_failures)
+{
+    std::lock_guard lock(mutex_);
+    const auto now = std::chrono::steady_clock::now();
+    for (const auto &[key, count] : {std::pair{UsernameKey(username), username_failures},
+                                     std::pair{AddressKey(address), address_failures}})
+    {
+        // Redis may not have applied this node's latest increments yet, so the larger count wins. Clean counters are
+        // not mirrored, which keeps the cache to the accounts and addresses with failures.
+        const auto *const local = failures_.Find(key, now);
+        if (count == 0 || (local != nullptr && *local >= count))
+        {
+            continue;
+        }
+        failures_.Insert(key, count, now + window_);
+    }
+}
+
+AsyncTask LoginThrottle::IncrementAsync(std::string username, std::string address)
+{
+    const auto failures =
+        co_await app().getPlugin<RedisManager>()->IncrementLoginFailures(username, address, window_);
+    if (!failures)
+    {
+        LOG_ERROR << fmt::format("{}", failures.error());
+        co_return;
+    }
+    Mirror(username, failures->username, address, failures->address);
+}
@@ -0,0 +1,54 @@
+/**
+ *
+ *  LoginThrottle.h
+ *
+ */
+
+#pragma once
+
+#include "utilities/LruCache.h"
+
+#include <atomic>
+#include <drogon/plugins/Plugin.h>
+#include <drogon/utils/coroutine.h>
+#include <mutex>
+
+/*
+ * Counts failed logins per username and per client address over a window, and rejects further attempts past a
+ * threshold before any password hashing, so that guessing or a client retrying in a loop cannot use up the Argon2
+ * capacity that legitimate logins need.
+ * Counters live in Redis (shared by every node) and are mirrored in process: an attempt already known to be over the
+ * limit is rejected without a round trip, and a mirrored counter lasts at most a window.
+ * The address is the TCP peer; behind a reverse proxy, that is the proxy's.
+ */
+class LoginThrottle : public drogon::Plugin<LoginThrottle>
+{
+  public:
+    void initAndStart(const Json::Value &config) override;
+    void shutdown() override;
+
+    // Whether the attempt may go on to the password check. Redis being unreachable only leaves the local counters.
+    drogon::Task<bool> Allow(const std::string &username, const std::string &address);
+    void RecordFailure(const std::string &username, const std::string &address);
+    void RecordSuccess(const std::string &username);
+    Json::Value GetMetrics() const;
+
+  private:
+    bool OverLimit(const std::string &username, const std::string &address);
+    void Mirror(const std::string &username, uint64_t username_failures, const std::string &address,
+                uint64_t address_failures);
+    drogon::AsyncTask IncrementAsync(std::string username, std::string address);
+
+    uint64_t max_username_failures_{};
+    uint64_t max_address_failures_{};
+    std::chrono::seconds window_{};
+
+    std::mutex mutex_;
+    // Keyed by "user:<username>" and "ip:<address>".
+    server::utilities::LruCache<std::string, uint64_t> failures_{1};
+
+    std::atomic<uint64_t> allowed_{0};
+    std::atomic<uint64_t> throttled_locally_{0};
+    std::atomic<uint64_t> throttled_{0};
+    std::atomic<uint64_t> failures_recorded_{0};
+};
@@ -8,25 +8,134 @@
 
 #include <botan/argon2.h>
 #include <botan/hex.h>
+#include <trantor/net/EventLoop.h>
 
 using namespace drogon;
 
+namespace
+{
+template <typename T> void StoreMax(std::atomic<T> &target, const T value)
+{
+    auto current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t ToMicroseconds(const std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+} // namespace
+
+void PasswordHasher::JobAwaiter::await_suspend(const std::coroutine_handle<> handle)
+{
+    auto *const loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+    const auto queued_at = std::chrono::steady_clock::now();
+    hasher_.pool_->runTaskInQueue([this, handle, loop, queued_at] {
+        const auto started_at = std::chrono::steady_clock::now();
+        job_();
+        const auto queue_wait_us = ToMicroseconds(started_at - queued_at);
+        const auto hash_time_us = ToMicroseconds(std::chrono::steady_clock::now() - started_at);
+        hasher_.total_queue_wait_us_.fetch_add(queue_wait_us, std::memory_order_relaxed);
+        StoreMax(hasher_.max_queue_wait_us_, queue_wait_us);
+        hasher_.total_hash_time_us_.fetch_add(hash_time_us, std::memory_order_relaxed);
+        StoreMax(hasher_.max_hash_time_us_, hash_time_us);
+        hasher_.completed_.fetch_add(1, std::memory_order_relaxed);
+        hasher_.jobs_.fetch_sub(1, std::memory_order_relaxed);
+        if (loop != nullptr)
+        {
+            loop->queueInLoop([handle] { handle.resume(); });
+        }
+        else
+        {
+            handle.resume();
+        }
+    });
+}
+
 void PasswordHasher::initAndStart(const Json::Value &config)
 {
     parallel_threads_ = config.get("parallel_threads", 4).asUInt();
     max_memory_mbs_ = config.get("max_memory", 1024).asUInt();
     iterations_ = config.get("iterations", 2).asUInt();
     thread_pool_size_ = config.get("thread_pool_size", std::thread::hardware_concurrency() >> 1).asUInt();
+    const auto memory_budget_mbs = config.get("memory_budget", 2 * max_memory_mbs_).asUInt();
+    concurrency_ = std::max<std::size_t>(memory_budget_mbs / std::max<uint32_t>(max_memory_mbs_, 1), 1);
+    max_jobs_ = concurrency_ + config.get("max_queue", 64).asUInt();
+    pool_ = std::make_unique<trantor::ConcurrentTaskQueue>(concurrency_, "PasswordHasher");
 // REFERENCE: https://github.com/randombit/botan/blob/bc555cd3c114497a50b49c4649d6606150881f5b/src/lib/utils/thread_utils/thread_pool.cpp#L20
 #if defined(_WIN32) && defined(_MSC_VER)
     _putenv_s("BOTAN_THREAD_POOL_SIZE", std::to_string(thread_pool_size_).c_str());
 #else
     setenv("BOTAN_THREAD_POOL_SIZE", std::to_string(thread_pool_size_).c_str(), 0);
 #endif
+
+    // Hashed once with the configured parameters, so that verifying against it costs as much as a real check.
+    Botan::AutoSeeded_RNG rng;
+    auto dummy_hash = HashPassword(Botan::hex_encode(rng.random_vec(16)));
+    ASSERT(dummy_hash.has_value(), "Failed to compute the dummy password hash");
+    dummy_hash_ = std::move(dummy_hash).value();
 }
 
 void PasswordHasher::shutdown()
 {
+    pool_->stop();
+}
+
+Task<std::expected<std::string, PasswordHasher::Error>> PasswordHasher::HashPasswordAsync(std::string password)
+{
+    std::optional<std::expected<std::string, Botan::Exception>> result;
+    if (!co_await RunOnPool([this, &password, &result] { result.emplace(HashPassword(password)); }))
+    {
+        co_return std::unexpected(Overloaded{});
+    }
+    if (!*result)
+    {
+        co_return std::unexpected(result->error());
+    }
+    co_return std::move(*result).value();
+}
+
+Task<std::expected<bool, PasswordHasher::Error>> PasswordHasher::VerifyPasswordAsync(std::string password,
+                                                                                     std::string hash)
+{
+    std::optional<std::expected<bool, Botan::Exception>> result;
+    if (!co_await RunOnPool([this, &password, &hash, &result] { result.emplace(VerifyPassword(password, hash)); }))
+    {
+        co_return std::unexpected(Overloaded{});
+    }
+    if (!*result)
+    {
+        co_return std::unexpected(result->error());
+    }
+    co_return result->value();
+}
+
+Json::Value PasswordHasher::GetMetrics() const
+{
+    Json::Value metrics;
+    metrics["concurrency"] = static_cast<Json::UInt64>(concurrency_);
+    metrics["jobs"] = static_cast<Json::UInt64>(jobs_.load(std::memory_order_relaxed));
+    metrics["completed"] = completed_.load(std::memory_order_relaxed);
+    metrics["rejected"] = rejected_.load(std::memory_order_relaxed);
+    metrics["total_queue_wait_us"] = total_queue_wait_us_.load(std::memory_order_relaxed);
+    metrics["max_queue_wait_us"] = max_queue_wait_us_.load(std::memory_order_relaxed);
+    metrics["total_hash_time_us"] = total_hash_time_us_.load(std::memory_order_relaxed);
+    metrics["max_hash_time_us"] = max_hash_time_us_.load(std::memory_order_relaxed);
+    return metrics;
+}
+
+Task<bool> PasswordHasher::RunOnPool(std::function<void()> job)
+{
+    if (jobs_.fetch_add(1, std::memory_order_relaxed) >= max_jobs_)
+    {
+        jobs_.fetch_sub(1, std::memory_order_relaxed);
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        co_return false;
+    }
+    co_await JobAwaiter(*this, std::move(job));
+    co_return true;
 }
 
 std::expected<std::string, Botan::Exception> PasswordHasher::HashPassword(const std::string &password) const noexcept
@@ -6,22 +6,87 @@
 
 #pragma once
 
+#include <atomic>
 #include <botan/auto_rng.h>
+#include <coroutine>
 #include <drogon/plugins/Plugin.h>
+#include <drogon/utils/coroutine.h>
+#include <trantor/utils/ConcurrentTaskQueue.h>
 
+/*
+ * Argon2 runs on a dedicated pool, never on the IO loops: a hash takes up to max_memory MB and a noticeable amount of
+ * time, so a burst of logins would otherwise stall every request on the loops that serve them.
+ * The pool runs memory_budget / max_memory hashes at once and lets at most max_queue more wait. Beyond that, the
+ * *Async functions fail immediately with Overloaded, which callers answer with 503.
+ */
 class PasswordHasher : public drogon::Plugin<PasswordHasher>
 {
   public:
+    // The hashing queue is full.
+    struct Overloaded
+    {
+    };
+    using Error = std::variant<Botan::Exception, Overloaded>;
+
     void initAndStart(const Json::Value &config) override;
     void shutdown() override;
 
+    // Resume on the caller's event loop once the pool is done.
+    drogon::Task<std::expected<std::string, Error>> HashPasswordAsync(std::string password);
+    drogon::Task<std::expected<bool, Error>> VerifyPasswordAsync(std::string password, std::string hash);
+
+    // Blocking, for the pool and for callers that are not on an IO loop.
     std::expected<std::string, Botan::Exception> HashPassword(const std::string &password) const noexcept;
     std::expected<bool, Botan::Exception> VerifyPassword(const std::string &password,
                                                          const std::string &hash) const noexcept;
+    // Hash of a random password, to verify against when there is no account, so that the answer takes as long as
+    // for an existing one.
+    const std::string &DummyHash() const
+    {
+        return dummy_hash_;
+    }
+    Json::Value GetMetrics() const;
 
   private:
+    class JobAwaiter
+    {
+      public:
+        JobAwaiter(PasswordHasher &hasher, std::function<void()> job) : hasher_(hasher), job_(std::move(job))
+        {
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const noexcept
+        {
+        }
+
+      private:
+        PasswordHasher &hasher_;
+        std::function<void()> job_;
+    };
+
+    // Runs the job on the pool; false, without running it, if the queue is full.
+    drogon::Task<bool> RunOnPool(std::function<void()> job);
+
     uint32_t parallel_threads_{};
     uint32_t max_memory_mbs_{};
     uint32_t iterations_{};
     uint32_t thread_pool_size_{};
+    std::size_t concurrency_{};
+    std::size_t max_jobs_{};
+    std::unique_ptr<trantor::ConcurrentTaskQueue> pool_;
+    std::string dummy_hash_;
+
+    // Queued and running jobs.
+    std::atomic<std::size_t> jobs_{0};
+    std::atomic<uint64_t> completed_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> total_queue_wait_us_{0};
+    std::atomic<uint64_t> max_queue_wait_us_{0};
+    std::atomic<uint64_t> total_hash_time_us_{0};
+    std::atomic<uint64_t> max_hash_time_us_{0};
 };
@@ -0,0 +1,200 @@
+/**
+ *
+ *  PresenceTracker.cc
+ *
+ */
+
+#include "PresenceTracker.h"
+#include "plugins/RedisManager.h"
+#include "utilities/FormatterUtil.h"
+
+#include <drogon/HttpAppFramework.h>
+
+using namespace drogon;
+using namespace server::utilities;
+
+namespace
+{
+template <typename T> void StoreMax(std::atomic<T> &target, const T value)
+{
+    auto current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+} // namespace
+
+void PresenceTracker::initAndStart(const Json::Value &config)
+{
+    flush_interval_ = std::chrono::milliseconds{config.get("flush_interval_ms", 1000).asUInt()};
+    max_batch_size_ = config.get("max_batch_size", 1000).asUInt();
+    room_sets_ = config.get("room_sets", false).asBool();
+    room_online_window_ = std::chrono::seconds{config.get("room_online_window", 300).asUInt()};
+    flush_timer_ = app().getLoop()->runEvery(std::chrono::duration<double>(flush_interval_).count(),
+                                             [this] { Flush(); });
+}
+
+void PresenceTracker::shutdown()
+{
+    app().getLoop()->invalidateTimer(flush_timer_);
+    const auto redis_client = app().getRedisClient();
+    for (const auto &command : TakeFlushBatch().commands)
+    {
+        try
+        {
+            redis_client->execCommandSync<std::string>([](const nosql::RedisResult &result) { return result.asString(); },
+                                                       command);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR << "Failed to flush presence on shutdown: " << e.what();
+        }
+    }
+}
+
+void PresenceTracker::Touch(const UserPrimaryKeyType user_id, const TimePoint time,
+                            const std::span<const RoomPrimaryKeyType> room_ids)
+{
+    const auto timestamp = ToSeconds(time.time_since_epoch());
+    std::lock_guard lock(pending_mutex_);
+    auto &pending = pending_[user_id];
+    pending = std::max(pending, timestamp);
+    if (room_sets_)
+    {
+        for (const auto room_id : room_ids)
+        {
+            auto &room_pending = pending_rooms_[room_id][user_id];
+            room_pending = std::max(room_pending, timestamp);
+        }
+    }
+}
+
+bool PresenceTracker::HasRoomSets() const
+{
+    return room_sets_;
+}
+
+std::chrono::seconds PresenceTracker::RoomOnlineWindow() const
+{
+    return room_online_window_;
+}
+
+Json::Value PresenceTracker::GetMetrics() const
+{
+    Json::Value metrics;
+    metrics["flushes"] = flushes_.load(std::memory_order_relaxed);
+    metrics["failed_flushes"] = failed_flushes_.load(std::memory_order_relaxed);
+    metrics["flushed_users"] = flushed_users_.load(std::memory_order_relaxed);
+    metrics["last_flush_size"] = last_flush_size_.load(std::memory_order_relaxed);
+    metrics["max_flush_size"] = max_flush_size_.load(std::memory_order_relaxed);
+    metrics["last_flush_latency_us"] = last_flush_latency_us_.load(std::memory_order_relaxed);
+    metrics["max_flush_latency_us"] = max_flush_latency_us_.load(std::memory_order_relaxed);
+    return metrics;
+}
+
+PresenceTracker::FlushBatch PresenceTracker::TakeFlushBatch()
+{
+    std::unordered_map<UserPrimaryKeyType, int64_t> pending;
+    std::unordered_map<RoomPrimaryKeyType, std::unordered_map<UserPrimaryKeyType, int64_t>> pending_rooms;
+    {
+        std::lock_guard lock(pending_mutex_);
+        pending.swap(pending_);
+        pending_rooms.swap(pending_rooms_);
+    }
+
+    FlushBatch batch;
+    batch.size = pending.size();
+    // GT: a node flushing late never moves a timestamp back.
+    const auto append_zadds = [this, &batch](const std::string_view key, const auto &timestamps) {
+        std::string command;
+        std::size_t command_size = 0;
+        for (const auto &[user_id, timestamp] : timestamps)
+        {
+            if (command_size == 0)
+            {
+                command = std::format("ZADD {} GT", key);
+            }
+            std::format_to(std::back_inserter(command), " {} {}", timestamp, user_id);
+            if (++command_size == max_batch_size_)
+            {
+                batch.commands.push_back(std::move(command));
+                command_size = 0;
+            }
+        }
+        if (command_size > 0)
+        {
+            batch.commands.push_back(std::move(command));
+        }
+    };
+    append_zadds(RedisManager::kPresenceKey, pending);
+    const auto cutoff = ToSeconds(std::chrono::system_clock::now().time_since_epoch() - room_online_window_);
+    for (const auto &[room_id, timestamps] : pending_rooms)
+    {
+        const auto key = RedisManager::RoomPresenceKey(room_id);
+        append_zadds(key, timestamps);
+        // Members who left the room or went offline age out here, and a room nobody touches again expires as a whole
+        // once its newest member is out of the window.
+        batch.commands.push_back(std::format("ZREMRANGEBYSCORE {} -inf ({}", key, cutoff));
+        batch.commands.push_back(std::format("EXPIRE {} {}", key, room_online_window_.count()));
+    }
+    return batch;
+}
+
+void PresenceTracker::Flush()
+{
+    auto batch = TakeFlushBatch();
+    if (batch.commands.empty())
+    {
+        return;
+    }
+
+    // All batches are sent back to back on the same connection, so they are pipelined; the flush is complete when
+    // the last reply arrives.
+    struct FlushState
+    {
+        std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+        std::size_t size{0};
+        std::atomic<std::size_t> remaining{0};
+        std::atomic<bool> succeeded{true};
+    };
+    auto state = std::make_shared<FlushState>();
+    state->size = batch.size;
+    state->remaining = batch.commands.size();
+
+    const auto redis_client = app().getRedisClient();
+    const auto on_reply = [this, state](const bool succeeded) {
+        if (!succeeded)
+        {
+            state->succeeded = false;
+        }
+        if (state->remaining.fetch_sub(1) == 1)
+        {
+            RecordFlush(state->size, std::chrono::steady_clock::now() - state->start, state->succeeded);
+        }
+    };
+    for (const auto &command : batch.commands)
+    {
+        redis_client->execCommandAsync([on_reply](const nosql::RedisResult &) { on_reply(true); },
+                                       [on_reply](const nosql::RedisException &e) {
+                                           LOG_ERROR << fmt::format("{}", e);
+                                           on_reply(false);
+                                       },
+                                       command);
+    }
+}
+
+void PresenceTracker::RecordFlush(const std::size_t size, const std::chrono::steady_clock::duration latency,
+                                  const bool succeeded)
+{
+    const auto latency_us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    flushes_.fetch_add(1, std::memory_order_relaxed);
+    if (!succeeded)
+    {
+        failed_flushes_.fetch_add(1, std::memory_order_relaxed);
+    }
+    flushed_users_.fetch_add(size, std::memory_order_relaxed);
+    last_flush_size_.store(size, std::memory_order_relaxed);
+    StoreMax<uint64_t>(max_flush_size_, size);
+    last_flush_latency_us_.store(latency_us, std::memory_order_relaxed);
+    StoreMax<int64_t>(max_flush_latency_us_, latency_us);
+}
@@ -0,0 +1,72 @@
+/**
+ *
+ *  PresenceTracker.h
+ *
+ */
+
+#pragma once
+
+#include "models/Room.h"
+#include "models/User.h"
+
+#include <atomic>
+#include <drogon/plugins/Plugin.h>
+#include <mutex>
+#include <span>
+#include <trantor/net/EventLoop.h>
+#include <unordered_map>
+
+/*
+ * Buffers last-online timestamps in process and writes them to Redis periodically.
+ * Touch() only updates an in-memory map; every flush_interval_ms all buffered users are written with one ZADD per
+ * max_batch_size users, so the Redis write rate is bounded by the flush rate instead of the ping rate. Whatever is
+ * still buffered is flushed synchronously on shutdown.
+ * Timestamps are the scores of the "presence" sorted set. With room_sets enabled, the rooms passed to Touch() also get
+ * a presence:room:<id> sorted set trimmed to room_online_window seconds, and expiring that long after its last
+ * update, so the online members of a room are one range query.
+ */
+class PresenceTracker : public drogon::Plugin<PresenceTracker>
+{
+  public:
+    using UserPrimaryKeyType = drogon_model::postgres::User::PrimaryKeyType;
+    using RoomPrimaryKeyType = drogon_model::postgres::Room::PrimaryKeyType;
+    using TimePoint = std::chrono::system_clock::time_point;
+
+    void initAndStart(const Json::Value &config) override;
+    void shutdown() override;
+
+    void Touch(UserPrimaryKeyType user_id, TimePoint time = std::chrono::system_clock::now(),
+               std::span<const RoomPrimaryKeyType> room_ids = {});
+    bool HasRoomSets() const;
+    std::chrono::seconds RoomOnlineWindow() const;
+    Json::Value GetMetrics() const;
+
+  private:
+    struct FlushBatch
+    {
+        std::vector<std::string> commands;
+        std::size_t size{0};
+    };
+
+    FlushBatch TakeFlushBatch();
+    void Flush();
+    void RecordFlush(std::size_t size, std::chrono::steady_clock::duration latency, bool succeeded);
+
+    std::chrono::milliseconds flush_interval_{};
+    std::size_t max_batch_size_{};
+    bool room_sets_{false};
+    std::chrono::seconds room_online_window_{};
+    trantor::TimerId flush_timer_{};
+
+    std::mutex pending_mutex_;
+    std::unordered_map<UserPrimaryKeyType, int64_t> pending_;
+    std::unordered_map<RoomPrimaryKeyType, std::unordered_map<UserPrimaryKeyType, int64_t>> pending_rooms_;
+
+    std::atomic<uint64_t> flushes_{0};
+    std::atomic<uint64_t> failed_flushes_{0};
+    std::atomic<uint64_t> flushed_users_{0};
+    std::atomic<uint64_t> last_flush_size_{0};
+    std::atomic<uint64_t> max_flush_size_{0};
+    std::atomic<int64_t> last_flush_latency_us_{0};
+    std::atomic<int64_t> max_flush_latency_us_{0};
+};
@@ -5,51 +5,363 @@
  */
 
 #include "RedisManager.h"
-#include "models/Helper.h"
 #include "utilities/FormatterUtil.h"
+#include "utilities/RedisCommand.h"
+#include "utilities/RefreshTokenValue.h"
 
 #include <drogon/HttpAppFramework.h>
 #include "fmt/ranges.h"
 
-#include <jwt-cpp/jwt.h>
+#include <botan/hash.h>
+#include <botan/hex.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
 
 using namespace drogon;
 using namespace server::utilities;
-using namespace server::models;
+
+namespace
+{
+// The command must stay alive until the returned awaiter completes.
+template <std::size_t N> auto ExecCommandCoro(const nosql::RedisClientPtr &redis_client, const RedisCommand<N> &command)
+{
+    return command.Apply([&redis_client](const auto... argv) { return redis_client->execCommandCoro(argv...); });
+}
+
+// KEYS: refresh_token:<user>:<id>, user:<user>. ARGV: the new access token value, "1" to also fetch the user record.
+// Returns nil if the refresh token is gone, {0} without changing anything if the user record was asked for but is not
+// cached, else {1, user record or nil}. KEEPTTL keeps the refresh token's expiry.
+// The expiry of the superseded access token is appended as ";prev:", see GetRefreshTokenState.
+constexpr std::string_view kRotateAccessTokenScript{"rotate_access_token"};
+constexpr std::string_view kRotateAccessTokenSource{R"lua(
+local previous = redis.call('GET', KEYS[1])
+if not previous then
+    return false
+end
+local user = false
+if ARGV[2] == '1' then
+    user = redis.call('GET', KEYS[2])
+    if not user then
+        return {0}
+    end
+end
+local previous_expiry = string.match(previous, ';exp:([%d_:-]+)')
+redis.call('SET', KEYS[1], previous_expiry and (ARGV[1] .. ';prev:' .. previous_expiry) or ARGV[1], 'KEEPTTL')
+return {1, user}
+)lua"};
+
+// KEYS: login failure counters. ARGV: the window in seconds. Returns the incremented counters.
+constexpr std::string_view kIncrementLoginFailuresScript{"increment_login_failures"};
+constexpr std::string_view kIncrementLoginFailuresSource{R"lua(
+local counts = {}
+for i, key in ipairs(KEYS) do
+    counts[i] = redis.call('INCR', key)
+    if counts[i] == 1 then
+        redis.call('EXPIRE', key, ARGV[1])
+    end
+end
+return counts
+)lua"};
+
+// Last-online timestamps used to be one last_online:<id> string per user. The migration moves them into the presence
+// sorted set once; the marker key keeps later startups from scanning again.
+constexpr std::string_view kLegacyLastOnlinePattern{"last_online:*"};
+constexpr std::string_view kLastOnlineMigratedKey{"migrations:last_online_presence"};
+constexpr std::size_t kLastOnlineMigrationScanCount{1000};
+
+// KEYS: the presence set, then last_online:<id> keys. Moves every timestamp into the set, keeping the newer one if the
+// user is already there, and deletes the old key. Returns the number of keys moved.
+constexpr std::string_view kMigrateLastOnlineSource{R"lua(
+for i = 2, #KEYS do
+    local timestamp = redis.call('GET', KEYS[i])
+    if timestamp then
+        redis.call('ZADD', KEYS[1], 'GT', timestamp, string.match(KEYS[i], ':(%d+)$'))
+    end
+    redis.call('DEL', KEYS[i])
+end
+return #KEYS - 1
+)lua"};
+
+bool IsLegacyLastOnlineKey(const std::string_view key)
+{
+    constexpr std::string_view kPrefix{"last_online:"};
+    return key.starts_with(kPrefix) && key.size() > kPrefix.size() &&
+           std::ranges::all_of(key.substr(kPrefix.size()), [](const char c) { return c >= '0' && c <= '9'; });
+}
+
+std::string UsernameLoginFailuresKey(const std::string &username)
+{
+    return std::format("login_failures:user:{}", username);
+}
+
+std::string AddressLoginFailuresKey(const std::string &address)
+{
+    return std::format("login_failures:ip:{}", address);
+}
+
+// Counters absent or not numbers count as no failure.
+uint64_t ParseLoginFailures(const nosql::RedisResult &result)
+{
+    if (result.type() == nosql::RedisResultType::kInteger)
+    {
+        return static_cast<uint64_t>(result.asInteger());
+    }
+    uint64_t count{0};
+    if (result.type() == nosql::RedisResultType::kString)
+    {
+        const auto value = result.asString();
+        std::from_chars(value.data(), value.data() + value.size(), count);
+    }
+    return count;
+}
+
+std::string RefreshTokenKey(const drogon_model::postgres::User::PrimaryKeyType user_id, const std::string &refresh_id)
+{
+    return std::format("refresh_token:{}:{}", user_id, refresh_id);
+}
+
+// Compact record stored at user:<id>: a version byte, the id as 4 little-endian bytes, then the username and the
+// role, each prefixed by its length as 2 little-endian bytes. Records written as JSON by older nodes start with '{'
+// and are still read.
+constexpr char kUserRecordVersion{0x01};
+
+template <std::unsigned_integral Integer> void AppendLittleEndian(std::string &out, const Integer value)
+{
+    for (std::size_t i = 0; i < sizeof(Integer); ++i)
+    {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+template <std::unsigned_integral Integer> std::optional<Integer> ReadLittleEndian(std::string_view &in)
+{
+    if (in.size() < sizeof(Integer))
+    {
+        return std::nullopt;
+    }
+    Integer value{0};
+    for (std::size_t i = 0; i < sizeof(Integer); ++i)
+    {
+        value |= static_cast<Integer>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    in.remove_prefix(sizeof(Integer));
+    return value;
+}
+
+std::optional<std::string> ReadString(std::string_view &in)
+{
+    const auto length = ReadLittleEndian<uint16_t>(in);
+    if (!length || in.size() < *length)
+    {
+        return std::nullopt;
+    }
+    std::string value(in.substr(0, *length));
+    in.remove_prefix(*length);
+    return value;
+}
+
+std::string EncodeUserRecord(const drogon_model::postgres::User &user)
+{
+    const auto &username = user.getValueOfUsername();
+    const auto &role = user.getValueOfRole();
+    std::string record;
+    record.reserve(1 + 4 + 2 + username.size() + 2 + role.size());
+    record.push_back(kUserRecordVersion);
+    AppendLittleEndian(record, static_cast<uint32_t>(user.getValueOfId()));
+    AppendLittleEndian(record, static_cast<uint16_t>(username.size()));
+    record.append(username);
+    AppendLittleEndian(record, static_cast<uint16_t>(role.size()));
+    record.append(role);
+    return record;
+}
+
+std::optional<drogon_model::postgres::User> DecodeUserRecord(std::string_view record)
+{
+    if (record.empty() || record.front() != kUserRecordVersion)
+    {
+        return std::nullopt;
+    }
+    record.remove_prefix(1);
+    const auto id = ReadLittleEndian<uint32_t>(record);
+    auto username = ReadString(record);
+    auto role = ReadString(record);
+    if (!id || !username || !role || !record.empty())
+    {
+        return std::nullopt;
+    }
+    drogon_model::postgres::User user;
+    user.setId(static_cast<drogon_model::postgres::User::PrimaryKeyType>(*id));
+    user.setUsername(std::move(*username));
+    user.setRole(std::move(*role));
+    return user;
+}
+std::expected<drogon_model::postgres::User, std::string> ParseUserRecord(const std::string &record)
+{
+    if (!record.starts_with('{'))
+    {
+        if (auto user = DecodeUserRecord(record))
+        {
+            return std::move(user).value();
+        }
+        return std::unexpected("Malformed user record");
+    }
+    try
+    {
+        Json::CharReaderBuilder reader;
+        Json::Value json;
+        std::string errs;
+        if (std::istringstream is(record); !Json::parseFromStream(reader, is, &json, &errs))
+        {
+            return std::unexpected(errs);
+        }
+        return drogon_model::postgres::User{json};
+    }
+    catch (const std::exception &e)
+    {
+        return std::unexpected(e.what());
+    }
+}
+} // namespace
 
 void RedisManager::initAndStart(const Json::Value &config)
 {
+    RegisterScript(kRotateAccessTokenScript, std::string(kRotateAccessTokenSource));
+    RegisterScript(kIncrementLoginFailuresScript, std::string(kIncrementLoginFailuresSource));
+    if (config.get("batch_reads", true).asBool())
+    {
+        read_batcher_ = std::make_unique<RedisReadBatcher>(config.get("max_batch_keys", 256).asUInt64());
+    }
+    MigrateLegacyLastOnline();
 }
 
 void RedisManager::shutdown()
 {
 }
 
-Task<std::expected<void, RedisManager::RedisOperationError>> RedisManager::StoreRefreshTokenId(
-    const std::string &refresh_token, const std::optional<std::string> &access_token_opt)
+void RedisManager::MigrateLegacyLastOnline()
 {
     const auto redis_client = app().getRedisClient();
-    const auto decoded = jwt::decode(refresh_token);
-    const auto value = access_token_opt
-                           .and_then([](const auto &access_token) -> std::optional<std::string> {
-                               const auto token_decoded = jwt::decode(access_token);
-                               return std::format("{};exp:{:%Y-%m-%d_%H:%M:%S}", token_decoded.get_id(),
-                                                  token_decoded.get_expires_at());
-                           })
-                           .value_or("1");
+    try
+    {
+        const auto already_migrated = redis_client->execCommandSync<bool>(
+            [](const nosql::RedisResult &result) { return result.asInteger() != 0; }, "EXISTS %s",
+            kLastOnlineMigratedKey.data());
+        if (already_migrated)
+        {
+            return;
+        }
+        // Idempotent, so nodes starting together may run it concurrently.
+        using ScanPage = std::pair<std::string, std::vector<std::string>>;
+        const auto scan_command = std::format("SCAN %s MATCH {} COUNT {}", kLegacyLastOnlinePattern,
+                                              kLastOnlineMigrationScanCount);
+        std::string cursor = "0";
+        long long migrated = 0;
+        do
+        {
+            auto [next_cursor, keys] = redis_client->execCommandSync<ScanPage>(
+                [](const nosql::RedisResult &result) {
+                    const auto reply = result.asArray();
+                    std::vector<std::string> keys;
+                    for (const auto &key : reply.at(1).asArray())
+                    {
+                        keys.push_back(key.asString());
+                    }
+                    return ScanPage{reply.at(0).asString(), std::move(keys)};
+                },
+                scan_command, cursor.c_str());
+            cursor = std::move(next_cursor);
+            std::erase_if(keys, [](const std::string &key) { return !IsLegacyLastOnlineKey(key); });
+            if (keys.empty())
+            {
+                continue;
+            }
+            const auto arguments = RedisArgumentFormat({keys.size() + 1, kPresenceKey}, keys);
+            if (!arguments)
+            {
+                throw nosql::RedisException(nosql::RedisErrorCode::kBadType, "Unexpected key in SCAN reply");
+            }
+            // The script source, spaces included, is a single %s argument.
+            migrated += redis_client->execCommandSync<long long>(
+                [](const nosql::RedisResult &result) { return result.asInteger(); }, "EVAL %s " + *arguments,
+                std::string(kMigrateLastOnlineSource).c_str());
+        } while (cursor != "0");
+        redis_client->execCommandSync<std::string>([](const nosql::RedisResult &result) { return result.asString(); },
+                                                   "SET %s 1", kLastOnlineMigratedKey.data());
+        LOG_INFO << std::format("Moved {} last_online:* timestamps into the {} sorted set", migrated, kPresenceKey);
+    }
+    catch (const nosql::RedisException &e)
+    {
+        // Nothing is lost: the marker is only set once every key was moved, so the next startup resumes.
+        LOG_ERROR << "Failed to migrate last_online:* keys: " << e.what();
+    }
+}
 
-    const auto insertion_command =
-        std::format("SET refresh_token:{}:{} {} EXAT {}", decoded.get_subject(), decoded.get_id(), value,
-                    ToSeconds(decoded.get_expires_at().time_since_epoch()));
+void RedisManager::RegisterScript(const std::string_view name, std::string source)
+{
+    const auto hash = Botan::HashFunction::create_or_throw("SHA-1");
+    hash->update(source);
+    auto sha1 = Botan::hex_encode(hash->final(), false);
+    scripts_.emplace(name, Script{std::move(source), std::move(sha1)});
+}
+
+template <typename... Args>
+Task<nosql::RedisResult> RedisManager::EvalScript(const std::string_view name, const int key_count,
+                                                  const Args &...args)
+{
+    const auto &script = scripts_.at(name);
+    const auto redis_client = app().getRedisClient();
     try
     {
-        const auto insertion_result = co_await redis_client->execCommandCoro(insertion_command);
-        if (insertion_result.asString() == "OK")
+        const RedisCommand eval_command("EVALSHA", script.sha1, key_count, args...);
+        co_return co_await ExecCommandCoro(redis_client, eval_command);
+    }
+    catch (const nosql::RedisException &e)
+    {
+        if (!std::string_view(e.what()).starts_with("NOSCRIPT"))
         {
-            co_return {};
+            throw;
         }
+    }
+    // Loading is idempotent, so concurrent callers racing here are harmless.
+    const RedisCommand load_command("SCRIPT", "LOAD", script.source);
+    co_await ExecCommandCoro(redis_client, load_command);
+    const RedisCommand eval_command("EVALSHA", script.sha1, key_count, args...);
+    co_return co_await ExecCommandCoro(redis_client, eval_command);
+}
 
-        co_return std::unexpected(insertion_result.asString());
+std::string RedisManager::RoomPresenceKey(const RoomPrimaryKeyType room_id)
+{
+    return std::format("presence:room:{}", room_id);
+}
+
+Json::Value RedisManager::GetMetrics() const
+{
+    return read_batcher_ ? read_batcher_->GetMetrics() : Json::Value{Json::objectValue};
+}
+
+Task<std::expected<std::optional<std::string>, RedisManager::RedisOperationError>> RedisManager::Get(
+    std::string key, const RedisReadBatcher::ReadOrdering ordering)
+{
+    if (read_batcher_)
+    {
+        auto result = co_await read_batcher_->Get(std::move(key), ordering);
+        if (!result)
+        {
+            co_return std::unexpected(std::move(result).error());
+        }
+        co_return std::move(result).value();
+    }
+    try
+    {
+        const RedisCommand command("GET", key);
+        const auto retrieval_result = co_await ExecCommandCoro(app().getRedisClient(), command);
+        if (retrieval_result.isNil())
+        {
+            co_return std::nullopt;
+        }
+        co_return retrieval_result.asString();
     }
     catch (const nosql::RedisException &e)
     {
@@ -57,16 +369,23 @@ Task<std::expected<void, RedisManager::RedisOperationError>> RedisManager::Store
     }
 }
 
-Task<std::expected<bool, RedisManager::RedisOperationError>> RedisManager::HasRefreshToken(
-    const std::string &refresh_token)
+Task<std::expected<void, RedisManager::RedisOperationError>> RedisManager::StoreRefreshTokenId(
+    const TokenContext &refresh, const std::optional<TokenContext> &access_opt)
 {
     const auto redis_client = app().getRedisClient();
-    const auto decoded = jwt::decode(refresh_token);
-    const auto retrieval_command = std::format("EXISTS refresh_token:{}:{}", decoded.get_subject(), decoded.get_id());
+    const auto value = access_opt ? AccessTokenValue(access_opt->token_id, access_opt->expires_at) : std::string("1");
+
+    const auto key = RefreshTokenKey(refresh.user_id, refresh.token_id);
+    const RedisCommand insertion_command("SET", key, value, "EXAT", ToSeconds(refresh.expires_at.time_since_epoch()));
     try
     {
-        const auto retrieval_result = co_await redis_client->execCommandCoro(retrieval_command);
-        co_return retrieval_result.asInteger();
+        const auto insertion_result = co_await ExecCommandCoro(redis_client, insertion_command);
+        if (insertion_result.asString() == "OK")
+        {
+            co_return {};
+        }
+
+        co_return std::unexpected(insertion_result.asString());
     }
     catch (const nosql::RedisException &e)
     {
@@ -75,14 +394,14 @@ Task<std::expected<bool, RedisManager::RedisOperationError>> RedisManager::HasRe
 }
 
 Task<std::expected<bool, RedisManager::RedisOperationError>> RedisManager::DeleteRefreshToken(
-    const std::string &refresh_token)
+    const TokenContext &refresh)
 {
     const auto redis_client = app().getRedisClient();
-    const auto decoded = jwt::decode(refresh_token);
-    const auto deletion_command = std::format("DEL refresh_token:{}:{}", decoded.get_subject(), decoded.get_id());
+    const auto key = RefreshTokenKey(refresh.user_id, refresh.token_id);
+    const RedisCommand deletion_command("DEL", key);
     try
     {
-        const auto deletion_result = co_await redis_client->execCommandCoro(deletion_command);
+        const auto deletion_result = co_await ExecCommandCoro(redis_client, deletion_command);
         co_return deletion_result.asInteger();
     }
     catch (const nosql::RedisException &e)
@@ -92,22 +411,71 @@ Task<std::expected<bool, RedisManager::RedisOperationError>> RedisManager::Delet
 }
 
 Task<std::expected<bool, RedisManager::RedisOperationError>> RedisManager::HasAccessToken(
-    const std::string &access_token)
+    const TokenContext &access)
 {
-    const auto redis_client = app().getRedisClient();
-    const auto decoded = jwt::decode(access_token);
-    const auto user_id = decoded.get_subject();
-    const auto token_id = decoded.get_id();
-    const auto refresh_token_id = decoded.get_payload_claim("refresh_id").as_string();
-    const auto retrieval_command = std::format("GET refresh_token:{}:{}", user_id, refresh_token_id);
+    // The client may have been issued the token a moment ago: a read sent before the rotation would reject it.
+    const auto retrieval_result = co_await Get(RefreshTokenKey(access.user_id, access.refresh_id),
+                                               RedisReadBatcher::ReadOrdering::kAfterPriorWrites);
+    if (!retrieval_result)
+    {
+        co_return std::unexpected(retrieval_result.error());
+    }
+    co_return retrieval_result->value_or("").starts_with(access.token_id);
+}
+
+Task<std::expected<std::optional<RedisManager::RefreshTokenState>, RedisManager::RedisOperationError>> RedisManager::
+    GetRefreshTokenState(const UserPrimaryKeyType user_id, const std::string &refresh_id)
+{
+    const auto retrieval_result =
+        co_await Get(RefreshTokenKey(user_id, refresh_id), RedisReadBatcher::ReadOrdering::kAfterPriorWrites);
+    if (!retrieval_result)
+    {
+        co_return std::unexpected(retrieval_result.error());
+    }
+    if (!*retrieval_result)
+    {
+        co_return std::nullopt;
+    }
+    auto state = ParseAccessTokenValue(**retrieval_result);
+    if (!state)
+    {
+        co_return std::unexpected(std::format("Malformed refresh token value for user {}", user_id));
+    }
+    co_return std::move(state);
+}
+
+Task<std::expected<RedisManager::AccessTokenRotation, RedisManager::RedisOperationError>> RedisManager::
+    RotateAccessToken(const TokenContext &refresh, const std::string &access_token_id,
+                      const TimePoint access_expires_at, const bool fetch_user)
+{
+    const auto refresh_key = RefreshTokenKey(refresh.user_id, refresh.token_id);
+    const auto user_key = std::format("user:{}", refresh.user_id);
+    const auto value = AccessTokenValue(access_token_id, access_expires_at);
     try
     {
-        if (const auto retrieval_result = co_await redis_client->execCommandCoro(retrieval_command);
-            retrieval_result.asString().starts_with(token_id))
+        const auto rotation_result =
+            co_await EvalScript(kRotateAccessTokenScript, 2, refresh_key, user_key, value, fetch_user ? "1" : "0");
+        AccessTokenRotation rotation;
+        if (rotation_result.isNil())
+        {
+            co_return rotation;
+        }
+        rotation.refresh_token_found = true;
+        const auto values = rotation_result.asArray();
+        rotation.rotated = !values.empty() && values[0].asInteger() == 1;
+        if (values.size() == 2 && !values[1].isNil())
         {
-            co_return true;
+            // A broken cached record only costs a database lookup.
+            if (auto user = ParseUserRecord(values[1].asString()))
+            {
+                rotation.user = std::move(user).value();
+            }
+            else
+            {
+                LOG_ERROR << fmt::format("{} for user {}", user.error(), refresh.user_id);
+            }
         }
-        co_return false;
+        co_return rotation;
     }
     catch (const nosql::RedisException &e)
     {
@@ -115,52 +483,92 @@ Task<std::expected<bool, RedisManager::RedisOperationError>> RedisManager::HasAc
     }
 }
 
-Task<std::expected<std::optional<drogon_model::postgres::User>, RedisManager::RedisOperationError>> RedisManager::
-    GetUserFromRedis(const drogon_model::postgres::User::PrimaryKeyType user_id)
+Task<std::expected<RedisManager::LoginFailures, RedisManager::RedisOperationError>> RedisManager::GetLoginFailures(
+    const std::string &username, const std::string &address)
 {
     const auto redis_client = app().getRedisClient();
-    const auto retrieval_command = std::format("GET user:{}", user_id);
+    const RedisCommand retrieval_command("MGET", UsernameLoginFailuresKey(username), AddressLoginFailuresKey(address));
     try
     {
-        const auto retrieval_result = co_await redis_client->execCommandCoro(retrieval_command);
-        if (retrieval_result.isNil())
+        const auto retrieval_result = co_await ExecCommandCoro(redis_client, retrieval_command);
+        const auto values = retrieval_result.asArray();
+        if (values.size() != 2)
         {
-            co_return std::nullopt;
+            co_return std::unexpected(std::string("Unexpected MGET reply size"));
         }
-        Json::CharReaderBuilder reader;
-        Json::Value json;
-        std::string errs;
-        if (std::istringstream is(retrieval_result.asString()); !Json::parseFromStream(reader, is, &json, &errs))
+        co_return LoginFailures{ParseLoginFailures(values[0]), ParseLoginFailures(values[1])};
+    }
+    catch (const nosql::RedisException &e)
+    {
+        co_return std::unexpected(e);
+    }
+}
+
+Task<std::expected<RedisManager::LoginFailures, RedisManager::RedisOperationError>> RedisManager::
+    IncrementLoginFailures(const std::string &username, const std::string &address, const std::chrono::seconds window)
+{
+    try
+    {
+        const auto increment_result =
+            co_await EvalScript(kIncrementLoginFailuresScript, 2, UsernameLoginFailuresKey(username),
+                                AddressLoginFailuresKey(address), window.count());
+        const auto values = increment_result.asArray();
+        if (values.size() != 2)
         {
-            co_return std::unexpected(errs);
+            co_return std::unexpected(std::string("Unexpected login failure counters"));
         }
-        co_return drogon_model::postgres::User{json};
+        co_return LoginFailures{ParseLoginFailures(values[0]), ParseLoginFailures(values[1])};
     }
     catch (const nosql::RedisException &e)
     {
         co_return std::unexpected(e);
     }
-    catch (const std::exception &e)
+}
+
+AsyncTask RedisManager::ClearLoginFailuresAsync(const std::string username)
+{
+    try
     {
-        co_return std::unexpected(e.what());
+        const auto redis_client = app().getRedisClient();
+        const RedisCommand deletion_command("DEL", UsernameLoginFailuresKey(username));
+        co_await ExecCommandCoro(redis_client, deletion_command);
     }
-    catch (...)
+    catch (const nosql::RedisException &e)
     {
-        throw std::runtime_error("Unknown error");
+        LOG_ERROR << e.what();
     }
 }
 
+Task<std::expected<std::optional<drogon_model::postgres::User>, RedisManager::RedisOperationError>> RedisManager::
+    GetUserFromRedis(const drogon_model::postgres::User::PrimaryKeyType user_id)
+{
+    const auto retrieval_result =
+        co_await Get(std::format("user:{}", user_id), RedisReadBatcher::ReadOrdering::kRelaxed);
+    if (!retrieval_result)
+    {
+        co_return std::unexpected(retrieval_result.error());
+    }
+    if (!*retrieval_result)
+    {
+        co_return std::nullopt;
+    }
+    auto user = ParseUserRecord(**retrieval_result);
+    if (!user)
+    {
+        co_return std::unexpected(std::move(user).error());
+    }
+    co_return std::move(user).value();
+}
+
 AsyncTask RedisManager::StoreUserInRedisAsync(const drogon_model::postgres::User user)
 {
     try
     {
         const auto redis_client = app().getRedisClient();
-        const auto masqueraded_json = user.toMasqueradedJson(kUserRedisInfoFields);
-        Json::StreamWriterBuilder writer;
-        writer["indentation"] = "";
-        const auto insertion_command =
-            std::format("SET user:{} {}", user.getValueOfId(), Json::writeString(writer, masqueraded_json));
-        co_await redis_client->execCommandCoro(insertion_command);
+        const auto key = std::format("user:{}", user.getValueOfId());
+        const auto value = EncodeUserRecord(user);
+        const RedisCommand insertion_command("SET", key, value);
+        co_await ExecCommandCoro(redis_client, insertion_command);
     }
     catch (const nosql::RedisException &e)
     {
@@ -179,23 +587,23 @@ AsyncTask RedisManager::StoreUserInRedisAsync(const drogon_model::postgres::User
 AsyncTask RedisManager::SetUserLastOnline(const UserPrimaryKeyType user_id, const TimePoint time)
 {
     const auto redis_client = app().getRedisClient();
-    const auto insertion_command = std::format("SET last_online:{} {}", user_id, ToSeconds(time.time_since_epoch()));
-    co_await redis_client->execCommandCoro(insertion_command);
+    const RedisCommand insertion_command("ZADD", kPresenceKey, "GT", ToSeconds(time.time_since_epoch()), user_id);
+    co_await ExecCommandCoro(redis_client, insertion_command);
 }
 
 Task<std::expected<RedisManager::LastOnlineOpt, RedisManager::RedisOperationError>> RedisManager::GetUserLastOnline(
     const UserPrimaryKeyType user_id)
 {
     const auto redis_client = app().getRedisClient();
-    const auto retrieval_command = std::format("GET last_online:{}", user_id);
+    const RedisCommand retrieval_command("ZSCORE", kPresenceKey, user_id);
     try
     {
-        const auto retrieval_result = co_await redis_client->execCommandCoro(retrieval_command);
+        const auto retrieval_result = co_await ExecCommandCoro(redis_client, retrieval_command);
         if (retrieval_result.isNil())
         {
             co_return std::nullopt;
         }
-        const auto timestamp = std::stoll(retrieval_result.asString());
+        const auto timestamp = static_cast<int64_t>(std::stod(retrieval_result.asString()));
         co_return std::chrono::system_clock::time_point{std::chrono::seconds{timestamp}};
     }
     catch (const nosql::RedisException &e)
@@ -203,20 +611,23 @@ Task<std::expected<RedisManager::LastOnlineOpt, RedisManager::RedisOperationErro
         co_return std::unexpected(e);
     }
 }
+
 drogon::Task<std::expected<std::vector<RedisManager::LastOnlineOpt>, RedisManager::RedisOperationError>> RedisManager::
     GetUsersLastOnline(const std::span<const UserPrimaryKeyType> user_ids)
 {
+    if (user_ids.empty())
+    {
+        co_return std::vector<LastOnlineOpt>{};
+    }
     const auto redis_client = app().getRedisClient();
-    std::vector<std::string> keys;
-    keys.reserve(user_ids.size());
-    for (const auto &user_id : user_ids)
+    const auto retrieval_command = RedisArgumentFormat({"ZMSCORE", kPresenceKey}, user_ids);
+    if (!retrieval_command)
     {
-        keys.push_back(std::format("last_online:{}", user_id));
+        co_return std::unexpected("Invalid ZMSCORE arguments");
     }
-    const auto retrieval_command = fmt::format("MGET {}", fmt::join(keys, " "));
     try
     {
-        const auto retrieval_result = co_await redis_client->execCommandCoro(retrieval_command);
+        const auto retrieval_result = co_await redis_client->execCommandCoro(*retrieval_command);
         std::vector<LastOnlineOpt> result;
         result.reserve(user_ids.size());
         for (const auto &value : retrieval_result.asArray())
@@ -227,7 +638,7 @@ drogon::Task<std::expected<std::vector<RedisManager::LastOnlineOpt>, RedisManage
             }
             else
             {
-                const auto timestamp = std::stoll(value.asString());
+                const auto timestamp = static_cast<int64_t>(std::stod(value.asString()));
                 result.push_back(std::chrono::system_clock::time_point{std::chrono::seconds{timestamp}});
             }
         }
@@ -238,3 +649,84 @@ drogon::Task<std::expected<std::vector<RedisManager::LastOnlineOpt>, RedisManage
         co_return std::unexpected(e);
     }
 }
+
+Task<std::expected<std::vector<RedisManager::OnlineUser>, RedisManager::RedisOperationError>> RedisManager::
+    GetRoomOnlineUsers(const RoomPrimaryKeyType room_id, const TimePoint since)
+{
+    const auto redis_client = app().getRedisClient();
+    const auto key = RoomPresenceKey(room_id);
+    const RedisCommand retrieval_command("ZRANGE", key, "+inf", ToSeconds(since.time_since_epoch()), "BYSCORE", "REV",
+                                         "WITHSCORES");
+    try
+    {
+        const auto retrieval_result = co_await ExecCommandCoro(redis_client, retrieval_command);
+        // Flat [member, score, member, score, ...] reply.
+        const auto values = retrieval_result.asArray();
+        std::vector<OnlineUser> result;
+        result.reserve(values.size() / 2);
+        for (std::size_t i = 0; i + 1 < values.size(); i += 2)
+        {
+            const auto user_id = static_cast<UserPrimaryKeyType>(std::stol(values[i].asString()));
+            const auto timestamp = static_cast<int64_t>(std::stod(values[i + 1].asString()));
+            result.emplace_back(user_id, std::chrono::system_clock::time_point{std::chrono::seconds{timestamp}});
+        }
+        co_return result;
+    }
+    catch (const nosql::RedisException &e)
+    {
+        co_return std::unexpected(e);
+    }
+}
+
+Task<std::expected<uint64_t, RedisManager::RedisOperationError>> RedisManager::NextRoomSequence(
+    const RoomPrimaryKeyType room_id)
+{
+    const auto redis_client = app().getRedisClient();
+    const auto key = std::format("room_seq:{}", room_id);
+    const RedisCommand increment_command("INCR", key);
+    try
+    {
+        const auto increment_result = co_await ExecCommandCoro(redis_client, increment_command);
+        co_return static_cast<uint64_t>(increment_result.asInteger());
+    }
+    catch (const nosql::RedisException &e)
+    {
+        co_return std::unexpected(e);
+    }
+}
+
+Task<std::expected<std::vector<uint64_t>, RedisManager::RedisOperationError>> RedisManager::GetRoomSequences(
+    const std::span<const RoomPrimaryKeyType> room_ids)
+{
+    if (room_ids.empty())
+    {
+        co_return std::vector<uint64_t>{};
+    }
+    const auto redis_client = app().getRedisClient();
+    std::vector<std::string> keys;
+    keys.reserve(room_ids.size());
+    for (const auto &room_id : room_ids)
+    {
+        keys.push_back(std::format("room_seq:{}", room_id));
+    }
+    const auto retrieval_command = RedisArgumentFormat({"MGET"}, keys);
+    if (!retrieval_command)
+    {
+        co_return std::unexpected("Invalid MGET arguments");
+    }
+    try
+    {
+        const auto retrieval_result = co_await redis_client->execCommandCoro(*retrieval_command);
+        std::vector<uint64_t> result;
+        result.reserve(room_ids.size());
+        for (const auto &value : retrieval_result.asArray())
+        {
+            result.push_back(value.isNil() ? 0 : std::stoull(value.asString()));
+        }
+        co_return result;
+    }
+    catch (const nosql::RedisException &e)
+    {
+        co_return std::unexpected(e);
+    }
+}
@@ -6,29 +6,83 @@
 
 #pragma once
 
+#include "models/Room.h"
 #include "models/User.h"
+#include "plugins/JwtTokenManager.h"
+#include "plugins/RedisReadBatcher.h"
+#include "utilities/RefreshTokenValue.h"
 
 #include <drogon/nosql/RedisException.h>
 #include <drogon/plugins/Plugin.h>
 #include <drogon/utils/coroutine.h>
 
+/*
+ * Multi-step operations that must be atomic run as Lua scripts registered in initAndStart. Scripts are called by
+ * EVALSHA with their locally computed SHA-1, and loaded with SCRIPT LOAD the first time Redis answers NOSCRIPT (fresh
+ * server, restart, SCRIPT FLUSH).
+ * Point reads (tokens, cached users, last-online timestamps) go through a RedisReadBatcher, so concurrent reads from
+ * one IO loop share MGETs and identical reads share one round trip. Token reads never join a read already sent, since
+ * it may predate the rotation that issued the token. Set batch_reads to false to send every read on its own.
+ */
 class RedisManager : public drogon::Plugin<RedisManager>
 {
   public:
     using RedisOperationError = std::variant<std::string, drogon::nosql::RedisException>;
     using User = drogon_model::postgres::User;
     using UserPrimaryKeyType = User::PrimaryKeyType;
+    using RoomPrimaryKeyType = drogon_model::postgres::Room::PrimaryKeyType;
     using TimePoint = std::chrono::system_clock::time_point;
     using LastOnlineOpt = std::optional<TimePoint>;
+    using OnlineUser = std::pair<UserPrimaryKeyType, TimePoint>;
+
+    struct AccessTokenRotation
+    {
+        bool refresh_token_found{false};
+        // False if the user was asked for but is not cached in Redis: nothing was changed.
+        bool rotated{false};
+        // The user cached in Redis, if asked for.
+        std::optional<User> user;
+    };
+
+    // Failed logins of a username and of a client address in the current window; see LoginThrottle.
+    struct LoginFailures
+    {
+        uint64_t username{0};
+        uint64_t address{0};
+    };
+
+    // What the last login or rotation left at a refresh token's key.
+    using RefreshTokenState = server::utilities::RefreshTokenState;
+
+    // Sorted set of every user's last-online time (score, in seconds).
+    static constexpr std::string_view kPresenceKey{"presence"};
+    // Same, restricted to the members recently online in the room; see PresenceTracker.
+    static std::string RoomPresenceKey(RoomPrimaryKeyType room_id);
 
     void initAndStart(const Json::Value &config) override;
     void shutdown() override;
 
+    // Token operations take the claims decoded by JwtTokenManager, so tokens are never parsed again here.
     drogon::Task<std::expected<void, RedisOperationError>> StoreRefreshTokenId(
-        const std::string &refresh_token, const std::optional<std::string> &access_token_opt = std::nullopt);
-    drogon::Task<std::expected<bool, RedisOperationError>> DeleteRefreshToken(const std::string &refresh_token);
-    drogon::Task<std::expected<bool, RedisOperationError>> HasRefreshToken(const std::string &refresh_token);
-    drogon::Task<std::expected<bool, RedisOperationError>> HasAccessToken(const std::string &access_token);
+        const TokenContext &refresh, const std::optional<TokenContext> &access_opt = std::nullopt);
+    drogon::Task<std::expected<bool, RedisOperationError>> DeleteRefreshToken(const TokenContext &refresh);
+    drogon::Task<std::expected<bool, RedisOperationError>> HasAccessToken(const TokenContext &access);
+    // nullopt if the refresh token does not exist.
+    drogon::Task<std::expected<std::optional<RefreshTokenState>, RedisOperationError>> GetRefreshTokenState(
+        UserPrimaryKeyType user_id, const std::string &refresh_id);
+    // In one round trip: checks that the refresh token exists, makes access_token_id its only valid access token, and
+    // with fetch_user, fetches the cached user of the token's subject. With fetch_user and no cached user, nothing is
+    // rotated, so the caller can load the user first and try again without it.
+    drogon::Task<std::expected<AccessTokenRotation, RedisOperationError>> RotateAccessToken(
+        const TokenContext &refresh, const std::string &access_token_id, TimePoint access_expires_at,
+        bool fetch_user);
+
+    drogon::Task<std::expected<LoginFailures, RedisOperationError>> GetLoginFailures(const std::string &username,
+                                                                                      const std::string &address);
+    // Counts one more failure for both; a counter's window starts with its first failure.
+    drogon::Task<std::expected<LoginFailures, RedisOperationError>> IncrementLoginFailures(
+        const std::string &username, const std::string &address, std::chrono::seconds window);
+    drogon::AsyncTask ClearLoginFailuresAsync(std::string username);
 
     drogon::Task<std::expected<std::optional<User>, RedisOperationError>> GetUserFromRedis(
         const UserPrimaryKeyType user_id);
@@ -39,4 +93,36 @@ class RedisManager : public drogon::Plugin<RedisManager>
     drogon::Task<std::expected<LastOnlineOpt, RedisOperationError>> GetUserLastOnline(const UserPrimaryKeyType user_id);
     drogon::Task<std::expected<std::vector<LastOnlineOpt>, RedisOperationError>> GetUsersLastOnline(
         const std::span<const UserPrimaryKeyType> user_ids);
+    // Members of the room online since the given time, most recent first. Only populated with PresenceTracker's
+    // room_sets enabled.
+    drogon::Task<std::expected<std::vector<OnlineUser>, RedisOperationError>> GetRoomOnlineUsers(
+        const RoomPrimaryKeyType room_id, const TimePoint since);
+
+    // Allocates the next event sequence of the room, shared by every node.
+    drogon::Task<std::expected<uint64_t, RedisOperationError>> NextRoomSequence(const RoomPrimaryKeyType room_id);
+    // Latest allocated sequence of each room, 0 for rooms without any sequenced event.
+    drogon::Task<std::expected<std::vector<uint64_t>, RedisOperationError>> GetRoomSequences(
+        const std::span<const RoomPrimaryKeyType> room_ids);
+
+    Json::Value GetMetrics() const;
+
+  private:
+    struct Script
+    {
+        std::string source;
+        std::string sha1;
+    };
+
+    // Moves last_online:<id> keys written by earlier versions into the presence sorted set, once per database.
+    void MigrateLegacyLastOnline();
+    void RegisterScript(std::string_view name, std::string source);
+    template <typename... Args>
+    drogon::Task<drogon::nosql::RedisResult> EvalScript(std::string_view name, int key_count, const Args &...args);
+    // GET through the read batcher when enabled.
+    drogon::Task<std::expected<std::optional<std::string>, RedisOperationError>> Get(
+        std::string key, RedisReadBatcher::ReadOrdering ordering);
+
+    std::unique_ptr<RedisReadBatcher> read_batcher_;
+    // Filled in initAndStart, read-only afterwards.
+    std::unordered_map<std::string_view, Script> scripts_;
 };
@@ -0,0 +1,176 @@
+/**
+ *
+ *  RedisReadBatcher.cc
+ *
+ */
+
+#include "RedisReadBatcher.h"
+#include "utilities/RedisCommand.h"
+
+#include <drogon/HttpAppFramework.h>
+#include <span>
+
+using namespace drogon;
+using namespace server::utilities;
+
+void RedisReadBatcher::GetAwaiter::await_suspend(const std::coroutine_handle<> handle)
+{
+    handle_ = handle;
+    batcher_.Enqueue(this);
+}
+
+RedisReadBatcher::RedisReadBatcher(const std::size_t max_batch_keys)
+    : max_batch_keys_(max_batch_keys == 0 ? 1 : max_batch_keys)
+{
+}
+
+Json::Value RedisReadBatcher::GetMetrics() const
+{
+    Json::Value metrics;
+    metrics["gets"] = gets_.load(std::memory_order_relaxed);
+    metrics["joined"] = joined_.load(std::memory_order_relaxed);
+    metrics["batches"] = batches_.load(std::memory_order_relaxed);
+    metrics["batched_keys"] = batched_keys_.load(std::memory_order_relaxed);
+    return metrics;
+}
+
+RedisReadBatcher::LoopState &RedisReadBatcher::StateOf(trantor::EventLoop *const loop)
+{
+    std::lock_guard lock(states_mutex_);
+    auto &state = states_[loop];
+    if (!state)
+    {
+        state = std::make_unique<LoopState>();
+    }
+    return *state;
+}
+
+void RedisReadBatcher::Enqueue(GetAwaiter *const awaiter)
+{
+    gets_.fetch_add(1, std::memory_order_relaxed);
+    auto *const loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+    if (loop == nullptr)
+    {
+        // Nothing to batch on outside an event loop.
+        GetDirectly(awaiter);
+        return;
+    }
+    auto &state = StateOf(loop);
+    if (awaiter->ordering_ == ReadOrdering::kRelaxed)
+    {
+        if (const auto it = state.in_flight.find(awaiter->key_); it != state.in_flight.end())
+        {
+            it->second->push_back(awaiter);
+            joined_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    auto &waiters = state.queued_waiters[awaiter->key_];
+    if (waiters)
+    {
+        waiters->push_back(awaiter);
+        joined_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    waiters = std::make_shared<Waiters>(1, awaiter);
+    state.queued.push_back(awaiter->key_);
+    if (state.queued.size() == 1)
+    {
+        // Runs after the handlers of the current iteration, which may queue more keys.
+        loop->queueInLoop([this, loop, &state] { Flush(loop, state); });
+    }
+}
+
+void RedisReadBatcher::Flush(trantor::EventLoop *const loop, LoopState &state)
+{
+    auto queued = std::move(state.queued);
+    state.queued.clear();
+    auto queued_waiters = std::move(state.queued_waiters);
+    state.queued_waiters.clear();
+    const auto redis_client = app().getRedisClient();
+    for (std::size_t begin = 0; begin < queued.size(); begin += max_batch_keys_)
+    {
+        const auto end = std::min(queued.size(), begin + max_batch_keys_);
+        auto flights = std::make_shared<std::vector<Flight>>();
+        flights->reserve(end - begin);
+        const auto command = RedisArgumentFormat({"MGET"}, std::span(queued).subspan(begin, end - begin));
+        for (auto i = begin; i < end; ++i)
+        {
+            auto &waiters = queued_waiters.at(queued[i]);
+            // Replaces an older flight of the key: relaxed reads now join the one that started last.
+            state.in_flight[queued[i]] = waiters;
+            flights->push_back({std::move(queued[i]), std::move(waiters)});
+        }
+        if (!command)
+        {
+            const nosql::RedisException error(nosql::RedisErrorCode::kBadType, "Invalid MGET arguments");
+            loop->queueInLoop([this, &state, flights, error] {
+                Complete(state, *flights, std::vector<Result>(flights->size(), std::unexpected(error)));
+            });
+            continue;
+        }
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        batched_keys_.fetch_add(flights->size(), std::memory_order_relaxed);
+        // Replies arrive on the Redis client's loop; waiters are resumed on their own.
+        redis_client->execCommandAsync(
+            [this, loop, &state, flights](const nosql::RedisResult &result) {
+                std::vector<Result> results;
+                results.reserve(flights->size());
+                for (const auto &value : result.asArray())
+                {
+                    results.emplace_back(value.isNil() ? Value{} : Value{value.asString()});
+                }
+                if (results.size() != flights->size())
+                {
+                    const nosql::RedisException error(nosql::RedisErrorCode::kBadType, "Unexpected MGET reply size");
+                    results.assign(flights->size(), std::unexpected(error));
+                }
+                loop->queueInLoop([this, &state, flights, results = std::move(results)]() mutable {
+                    Complete(state, *flights, std::move(results));
+                });
+            },
+            [this, loop, &state, flights](const nosql::RedisException &e) {
+                loop->queueInLoop([this, &state, flights, e] {
+                    Complete(state, *flights, std::vector<Result>(flights->size(), std::unexpected(e)));
+                });
+            },
+            *command);
+    }
+}
+
+void RedisReadBatcher::Complete(LoopState &state, const std::vector<Flight> &flights, std::vector<Result> results)
+{
+    for (std::size_t i = 0; i < flights.size(); ++i)
+    {
+        const auto &flight = flights[i];
+        // Detached before resuming anything, so that a resumed coroutine reading the key again starts a new flight.
+        if (const auto it = state.in_flight.find(flight.key);
+            it != state.in_flight.end() && it->second == flight.waiters)
+        {
+            state.in_flight.erase(it);
+        }
+        for (auto *const awaiter : *flight.waiters)
+        {
+            awaiter->result_ = results[i];
+            awaiter->handle_.resume();
+        }
+    }
+}
+
+void RedisReadBatcher::GetDirectly(GetAwaiter *const awaiter)
+{
+    const auto redis_client = app().getRedisClient();
+    const RedisCommand command("GET", awaiter->key_);
+    command.Apply([&redis_client, awaiter](const auto... argv) {
+        redis_client->execCommandAsync(
+            [awaiter](const nosql::RedisResult &result) {
+                awaiter->result_ = result.isNil() ? Value{} : Value{result.asString()};
+                awaiter->handle_.resume();
+            },
+            [awaiter](const nosql::RedisException &e) {
+                awaiter->result_ = std::unexpected(e);
+                awaiter->handle_.resume();
+            },
+            argv...);
+    });
+}
@@ -0,0 +1,112 @@
+/**
+ *
+ *  RedisReadBatcher.h
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <drogon/nosql/RedisClient.h>
+#include <expected>
+#include <json/value.h>
+#include <mutex>
+#include <optional>
+#include <trantor/net/EventLoop.h>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Coalesces the GETs awaited on one event loop during one loop iteration into a single MGET, and lets a GET for a key
+ * whose read is already in flight join that read instead of issuing its own (single-flight). Replies are
+ * demultiplexed back to every waiting coroutine on the loop it suspended on.
+ * Under bursty login and refresh traffic this turns N round trips for N requests into one per loop iteration.
+ * A read sent before a write may miss it, so only ReadOrdering::kRelaxed reads join a flight already sent; reads that
+ * must observe every write completed before them (kAfterPriorWrites) only share the MGET of their own iteration.
+ */
+class RedisReadBatcher
+{
+  public:
+    using Value = std::optional<std::string>;
+    using Result = std::expected<Value, drogon::nosql::RedisException>;
+
+    enum class ReadOrdering
+    {
+        // Any value the key held since the read started will do, e.g. a cached record.
+        kRelaxed,
+        // Must reflect writes that completed before the read started, e.g. a token the caller was just issued.
+        kAfterPriorWrites
+    };
+
+    class GetAwaiter
+    {
+      public:
+        GetAwaiter(RedisReadBatcher &batcher, std::string key, const ReadOrdering ordering)
+            : batcher_(batcher), key_(std::move(key)), ordering_(ordering)
+        {
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle);
+        Result await_resume()
+        {
+            return std::move(result_);
+        }
+
+      private:
+        friend class RedisReadBatcher;
+
+        RedisReadBatcher &batcher_;
+        std::string key_;
+        ReadOrdering ordering_;
+        std::coroutine_handle<> handle_;
+        Result result_;
+    };
+
+    explicit RedisReadBatcher(std::size_t max_batch_keys);
+
+    GetAwaiter Get(std::string key, const ReadOrdering ordering)
+    {
+        return {*this, std::move(key), ordering};
+    }
+    Json::Value GetMetrics() const;
+
+  private:
+    using Waiters = std::vector<GetAwaiter *>;
+
+    // One GET inside an MGET and the coroutines waiting for its value.
+    struct Flight
+    {
+        std::string key;
+        std::shared_ptr<Waiters> waiters;
+    };
+
+    // Only touched from its loop once created.
+    struct LoopState
+    {
+        // Keys not sent yet, in queueing order, and their waiters. Every read may join these.
+        std::vector<std::string> queued;
+        std::unordered_map<std::string, std::shared_ptr<Waiters>> queued_waiters;
+        // Waiters of the latest flight sent for every key still awaiting its reply. Only relaxed reads join these.
+        std::unordered_map<std::string, std::shared_ptr<Waiters>> in_flight;
+    };
+
+    LoopState &StateOf(trantor::EventLoop *loop);
+    void Enqueue(GetAwaiter *awaiter);
+    void Flush(trantor::EventLoop *loop, LoopState &state);
+    void Complete(LoopState &state, const std::vector<Flight> &flights, std::vector<Result> results);
+    static void GetDirectly(GetAwaiter *awaiter);
+
+    std::size_t max_batch_keys_;
+    std::mutex states_mutex_;
+    std::unordered_map<trantor::EventLoop *, std::unique_ptr<LoopState>> states_;
+
+    std::atomic<uint64_t> gets_{0};
+    std::atomic<uint64_t> joined_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> batched_keys_{0};
+};
@@ -0,0 +1,194 @@
+/**
+ *
+ *  RevocationList.cc
+ *
+ */
+
+#include "RevocationList.h"
+#include "plugins/RedisManager.h"
+#include "utilities/FormatterUtil.h"
+
+#include <charconv>
+#include <drogon/HttpAppFramework.h>
+
+using namespace drogon;
+using namespace server::utilities;
+
+namespace
+{
+// Margin for the subscription to become active after psubscribe is sent.
+constexpr std::chrono::seconds kSubscriptionGrace{5};
+constexpr double kFalsePositiveRate{0.01};
+
+uint64_t Hash(const std::string_view refresh_id)
+{
+    return std::hash<std::string_view>{}(refresh_id);
+}
+} // namespace
+
+void RevocationList::initAndStart(const Json::Value &config)
+{
+    enabled_ = config.get("enabled", false).asBool();
+    if (!enabled_)
+    {
+        return;
+    }
+    expected_revocations_ = config.get("expected_revocations", 100000).asUInt64();
+    filter_.store(NewFilter());
+    trusted_since_ = std::chrono::ceil<std::chrono::seconds>(std::chrono::system_clock::now()) + kSubscriptionGrace;
+
+    // Notifications are enabled by AccessTokenCache.
+    subscriber_ = app().getRedisClient()->newSubscriber();
+    const auto redis_db_index = app().getCustomConfig()["redis_clients"].get("db_index", 0).asUInt();
+    subscriber_->psubscribe(
+        std::format("__keyspace@{}__:refresh_token:*", redis_db_index),
+        [this](const std::string &channel, const std::string &event) {
+            // ...:refresh_token:<user_id>:<refresh_id>
+            constexpr std::string_view kPrefix = "refresh_token:";
+            const auto prefix = channel.find(kPrefix);
+            const auto separator = channel.rfind(':');
+            if (prefix == std::string::npos || separator < prefix + kPrefix.size())
+            {
+                return;
+            }
+            drogon_model::postgres::User::PrimaryKeyType user_id{};
+            const auto *const begin = channel.data() + prefix + kPrefix.size();
+            const auto *const end = channel.data() + separator;
+            if (const auto [ptr, ec] = std::from_chars(begin, end, user_id); ec == std::errc{} && ptr == end)
+            {
+                OnRefreshTokenEvent(user_id, channel.substr(separator + 1), event);
+            }
+        });
+    sweep_timer_ = app().getLoop()->runEvery(config.get("sweep_interval", 60).asDouble(), [this] { Sweep(); });
+}
+
+void RevocationList::shutdown()
+{
+    if (enabled_)
+    {
+        app().getLoop()->invalidateTimer(sweep_timer_);
+    }
+    subscriber_.reset();
+}
+
+RevocationList::Verdict RevocationList::Check(const TokenContext &access) const
+{
+    if (!enabled_ || access.issued_at < trusted_since_)
+    {
+        unknown_.fetch_add(1, std::memory_order_relaxed);
+        return Verdict::kUnknown;
+    }
+    if (!filter_.load(std::memory_order_acquire)->MayContain(Hash(access.refresh_id)))
+    {
+        filter_passes_.fetch_add(1, std::memory_order_relaxed);
+        return Verdict::kValid;
+    }
+
+    std::shared_lock lock(mutex_);
+    const auto it = revocations_.find(access.refresh_id);
+    if (it == revocations_.end() ||
+        (!it->second.access_token_id.empty() &&
+         (access.token_id == it->second.access_token_id || access.expires_at > it->second.access_expires_at)))
+    {
+        map_passes_.fetch_add(1, std::memory_order_relaxed);
+        return Verdict::kValid;
+    }
+    revoked_.fetch_add(1, std::memory_order_relaxed);
+    return Verdict::kRevoked;
+}
+
+Json::Value RevocationList::GetMetrics() const
+{
+    Json::Value metrics;
+    metrics["enabled"] = enabled_;
+    metrics["filter_passes"] = filter_passes_.load(std::memory_order_relaxed);
+    metrics["map_passes"] = map_passes_.load(std::memory_order_relaxed);
+    metrics["revoked"] = revoked_.load(std::memory_order_relaxed);
+    metrics["unknown"] = unknown_.load(std::memory_order_relaxed);
+    metrics["recorded"] = recorded_.load(std::memory_order_relaxed);
+    {
+        std::shared_lock lock(mutex_);
+        metrics["revocations"] = static_cast<Json::UInt64>(revocations_.size());
+    }
+    return metrics;
+}
+
+void RevocationList::OnRefreshTokenEvent(const drogon_model::postgres::User::PrimaryKeyType user_id,
+                                         std::string refresh_id, const std::string &event)
+{
+    if (event == "set")
+    {
+        // A login or a rotation; only the key's new value tells which.
+        RecordRotation(user_id, std::move(refresh_id));
+    }
+    else if (event == "del" || event == "expired")
+    {
+        // Every access token of the refresh token is revoked, the last one expiring at most a lifetime from now.
+        Record(refresh_id, {"", TimePoint::max(), app().getPlugin<JwtTokenManager>()->NextAccessTokenExpiry()});
+    }
+}
+
+AsyncTask RevocationList::RecordRotation(const drogon_model::postgres::User::PrimaryKeyType user_id,
+                                         std::string refresh_id)
+{
+    const auto state = co_await app().getPlugin<RedisManager>()->GetRefreshTokenState(user_id, refresh_id);
+    if (!state)
+    {
+        // The superseded token stays usable until it expires.
+        LOG_ERROR << fmt::format("Failed to read refresh token of user {}: {}", user_id, state.error());
+        co_return;
+    }
+    if (!*state)
+    {
+        // Deleted meanwhile; its own notification revokes everything.
+        co_return;
+    }
+    const auto &superseded_expires_at = (*state)->superseded_expires_at;
+    if (superseded_expires_at && *superseded_expires_at > std::chrono::system_clock::now())
+    {
+        Record(refresh_id, {(*state)->access_token_id, (*state)->access_expires_at, *superseded_expires_at});
+    }
+}
+
+void RevocationList::Record(const std::string &refresh_id, Revocation revocation)
+{
+    std::unique_lock lock(mutex_);
+    const auto [it, inserted] = revocations_.try_emplace(refresh_id, revocation);
+    if (!inserted)
+    {
+        auto &current = it->second;
+        const auto drop_at = std::max(current.drop_at, revocation.drop_at);
+        // Replies to concurrent reads may arrive out of order: keep the latest state, and a full revocation for good.
+        if (!current.access_token_id.empty() && revocation.access_expires_at >= current.access_expires_at)
+        {
+            current = std::move(revocation);
+        }
+        current.drop_at = drop_at;
+    }
+    filter_.load(std::memory_order_acquire)->Add(Hash(refresh_id));
+    recorded_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RevocationList::Sweep()
+{
+    // One second of margin for the expiry check of the tokens themselves.
+    const auto now = std::chrono::system_clock::now() - std::chrono::seconds{1};
+    std::unique_lock lock(mutex_);
+    const auto dropped = std::erase_if(revocations_, [now](const auto &entry) { return entry.second.drop_at < now; });
+    if (dropped == 0)
+    {
+        return;
+    }
+    // Bloom filters cannot forget, so the remaining revocations go into a new one.
+    auto filter = NewFilter();
+    for (const auto &[refresh_id, revocation] : revocations_)
+    {
+        filter->Add(Hash(refresh_id));
+    }
+    filter_.store(std::move(filter), std::memory_order_release);
+}
+
+std::shared_ptr<BloomFilter> RevocationList::NewFilter() const
+{
+    return std::make_shared<BloomFilter>(std::max(expected_revocations_, 2 * revocations_.size()), kFalsePositiveRate);
+}
@@ -0,0 +1,81 @@
+/**
+ *
+ *  RevocationList.h
+ *
+ */
+
+#pragma once
+
+#include "plugins/JwtTokenManager.h"
+#include "utilities/BloomFilter.h"
+
+#include <atomic>
+#include <drogon/nosql/RedisSubscriber.h>
+#include <drogon/plugins/Plugin.h>
+#include <drogon/utils/coroutine.h>
+#include <shared_mutex>
+#include <unordered_map>
+
+/*
+ * Optional stateless check of access tokens. Instead of asking Redis on every request whether an access token is
+ * still the current one of its refresh token, each node keeps the revocations it learned from refresh_token:*
+ * keyspace notifications: logouts and expiries revoke every token of the refresh token, rotations revoke the token
+ * they superseded until it expires. A Bloom filter of the affected refresh token ids sits in front of the exact map,
+ * so a token of any other session passes on signature and expiry alone with a few bit tests.
+ * Revocations take effect when their notification arrives instead of immediately. The node only knows revocations
+ * made since it subscribed, so tokens issued before that (or without an iat claim) still need the Redis check.
+ */
+class RevocationList : public drogon::Plugin<RevocationList>
+{
+  public:
+    using TimePoint = std::chrono::system_clock::time_point;
+
+    enum class Verdict
+    {
+        kValid,
+        kRevoked,
+        // Disabled, or the token may have been revoked before this node subscribed: ask Redis.
+        kUnknown,
+    };
+
+    void initAndStart(const Json::Value &config) override;
+    void shutdown() override;
+
+    Verdict Check(const TokenContext &access) const;
+    Json::Value GetMetrics() const;
+
+  private:
+    struct Revocation
+    {
+        // The access token still valid, empty if none is.
+        std::string access_token_id;
+        // Tokens expiring later were issued after the revocation and are not covered by it.
+        TimePoint access_expires_at;
+        // Every token the entry revokes has expired by then.
+        TimePoint drop_at;
+    };
+
+    void OnRefreshTokenEvent(drogon_model::postgres::User::PrimaryKeyType user_id, std::string refresh_id,
+                             const std::string &event);
+    drogon::AsyncTask RecordRotation(drogon_model::postgres::User::PrimaryKeyType user_id, std::string refresh_id);
+    void Record(const std::string &refresh_id, Revocation revocation);
+    void Sweep();
+    std::shared_ptr<server::utilities::BloomFilter> NewFilter() const;
+
+    bool enabled_{false};
+    std::size_t expected_revocations_{};
+    TimePoint trusted_since_;
+    std::shared_ptr<drogon::nosql::RedisSubscriber> subscriber_;
+    trantor::TimerId sweep_timer_{};
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, Revocation> revocations_;
+    // Replaced by Sweep() under the exclusive lock, read without it.
+    std::atomic<std::shared_ptr<server::utilities::BloomFilter>> filter_;
+
+    mutable std::atomic<uint64_t> filter_passes_{0};
+    mutable std::atomic<uint64_t> map_passes_{0};
+    mutable std::atomic<uint64_t> revoked_{0};
+    mutable std::atomic<uint64_t> unknown_{0};
+    std::atomic<uint64_t> recorded_{0};
+};
@@ -0,0 +1,131 @@
+/**
+ *
+ *  UserCache.cc
+ *
+ */
+
+#include "UserCache.h"
+
+#include <charconv>
+#include <drogon/HttpAppFramework.h>
+
+using namespace drogon;
+
+void UserCache::initAndStart(const Json::Value &config)
+{
+    const auto capacity = config.get("capacity", 10000).asUInt64();
+    ttl_ = std::chrono::seconds{config.get("ttl_seconds", 60).asUInt()};
+    shards_.reserve(kShardCount);
+    for (std::size_t i = 0; i < kShardCount; ++i)
+    {
+        shards_.push_back(std::make_unique<Shard>((capacity + kShardCount - 1) / kShardCount));
+    }
+
+    // Keyspace notifications are enabled by AccessTokenCache.
+    subscriber_ = app().getRedisClient()->newSubscriber();
+    const auto redis_db_index = app().getCustomConfig()["redis_clients"].get("db_index", 0).asUInt();
+    subscriber_->psubscribe(std::format("__keyspace@{}__:user:*", redis_db_index),
+                            [this](const std::string &channel, const std::string &) {
+                                constexpr std::string_view kPrefix = "user:";
+                                const auto pos = channel.find(kPrefix);
+                                if (pos == std::string::npos)
+                                {
+                                    return;
+                                }
+                                const std::string_view id = std::string_view(channel).substr(pos + kPrefix.size());
+                                UserPrimaryKeyType user_id{};
+                                if (const auto [ptr, ec] = std::from_chars(id.data(), id.data() + id.size(), user_id);
+                                    ec == std::errc{} && ptr == id.data() + id.size())
+                                {
+                                    Invalidate(user_id);
+                                }
+                            });
+}
+
+void UserCache::shutdown()
+{
+    subscriber_.reset();
+}
+
+Task<std::expected<std::optional<UserCache::User>, UserCache::RedisOperationError>> UserCache::Get(
+    const UserPrimaryKeyType user_id)
+{
+    if (auto user = FindLocal(user_id))
+    {
+        co_return std::move(user);
+    }
+
+    const auto read_start = std::chrono::steady_clock::now();
+    auto redis_result = co_await app().getPlugin<RedisManager>()->GetUserFromRedis(user_id);
+    if (!redis_result)
+    {
+        co_return std::unexpected(std::move(redis_result).error());
+    }
+    if (!*redis_result)
+    {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        co_return std::nullopt;
+    }
+    InsertFromRedis(**redis_result, read_start);
+    co_return std::move(redis_result).value();
+}
+
+std::optional<UserCache::User> UserCache::FindLocal(const UserPrimaryKeyType user_id)
+{
+    auto &shard = ShardFor(user_id);
+    std::lock_guard lock(shard.mutex);
+    if (const auto *user = shard.users.Find(user_id, std::chrono::steady_clock::now()))
+    {
+        local_hits_.fetch_add(1, std::memory_order_relaxed);
+        return *user;
+    }
+    return std::nullopt;
+}
+
+void UserCache::InsertFromRedis(const User &user, const std::chrono::steady_clock::time_point read_start)
+{
+    redis_hits_.fetch_add(1, std::memory_order_relaxed);
+    InsertLocal(user, read_start);
+}
+
+void UserCache::Store(const User &user)
+{
+    app().getPlugin<RedisManager>()->StoreUserInRedisAsync(user);
+}
+
+Json::Value UserCache::GetMetrics() const
+{
+    Json::Value metrics;
+    metrics["local_hits"] = local_hits_.load(std::memory_order_relaxed);
+    metrics["redis_hits"] = redis_hits_.load(std::memory_order_relaxed);
+    metrics["misses"] = misses_.load(std::memory_order_relaxed);
+    metrics["invalidations"] = invalidations_.load(std::memory_order_relaxed);
+    return metrics;
+}
+
+UserCache::Shard &UserCache::ShardFor(const UserPrimaryKeyType user_id)
+{
+    return *shards_[static_cast<std::size_t>(user_id) % kShardCount];
+}
+
+void UserCache::InsertLocal(const User &user, const std::chrono::steady_clock::time_point read_start)
+{
+    auto &shard = ShardFor(user.getValueOfId());
+    std::lock_guard lock(shard.mutex);
+    // Checked under the shard lock, under which Invalidate() records the user.
+    const auto now = std::chrono::steady_clock::now();
+    if (!shard.invalidations.MayCache(user.getValueOfId(), read_start, now))
+    {
+        return;
+    }
+    shard.users.Insert(user.getValueOfId(), user, now + ttl_);
+}
+
+void UserCache::Invalidate(const UserPrimaryKeyType user_id)
+{
+    invalidations_.fetch_add(1, std::memory_order_relaxed);
+    auto &shard = ShardFor(user_id);
+    std::lock_guard lock(shard.mutex);
+    shard.invalidations.Record(user_id, std::chrono::steady_clock::now());
+    shard.users.Erase(user_id);
+}
@@ -0,0 +1,74 @@
+/**
+ *
+ *  UserCache.h
+ *
+ */
+
+#pragma once
+
+#include "plugins/RedisManager.h"
+#include "utilities/LruCache.h"
+#include "utilities/RecentInvalidations.h"
+
+#include <atomic>
+#include <drogon/nosql/RedisSubscriber.h>
+#include <drogon/plugins/Plugin.h>
+#include <mutex>
+#include <vector>
+
+/*
+ * Two-tier user cache: a per-process LRU in front of the user:<id> records kept in Redis by RedisManager.
+ * A local hit is a hash lookup and a copy. Any change of a user:* key, from this node or another one, is delivered by
+ * keyspace notification and drops the local copy, and ttl_seconds bounds staleness if a notification is lost.
+ */
+class UserCache : public drogon::Plugin<UserCache>
+{
+  public:
+    using User = drogon_model::postgres::User;
+    using UserPrimaryKeyType = User::PrimaryKeyType;
+    using RedisOperationError = RedisManager::RedisOperationError;
+
+    void initAndStart(const Json::Value &config) override;
+    void shutdown() override;
+
+    // nullopt when the user is in neither tier.
+    drogon::Task<std::expected<std::optional<User>, RedisOperationError>> Get(UserPrimaryKeyType user_id);
+    // Local tier only, for callers that read the Redis record themselves as part of another command.
+    std::optional<User> FindLocal(UserPrimaryKeyType user_id);
+    // read_start is when such a Redis read began: InsertFromRedis() ignores the user if it changed since.
+    void InsertFromRedis(const User &user, std::chrono::steady_clock::time_point read_start);
+    // Writes the user to Redis in the background. The write's own notification drops any local copy, which the next
+    // Get() refills.
+    void Store(const User &user);
+    Json::Value GetMetrics() const;
+
+  private:
+    static constexpr std::size_t kShardCount = 16;
+    // How long an invalidation is remembered; reads taking longer are not cached.
+    static constexpr std::chrono::seconds kInvalidationWindow{10};
+
+    struct alignas(64) Shard
+    {
+        explicit Shard(const std::size_t capacity) : users(capacity), invalidations(kInvalidationWindow)
+        {
+        }
+
+        std::mutex mutex;
+        server::utilities::LruCache<UserPrimaryKeyType, User> users;
+        server::utilities::RecentInvalidations<UserPrimaryKeyType> invalidations;
+    };
+
+    Shard &ShardFor(UserPrimaryKeyType user_id);
+    // Ignored if the user changed since read_start, as the value may predate that change.
+    void InsertLocal(const User &user, std::chrono::steady_clock::time_point read_start);
+    void Invalidate(UserPrimaryKeyType user_id);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::chrono::seconds ttl_{};
+    std::shared_ptr<drogon::nosql::RedisSubscriber> subscriber_;
+
+    std::atomic<uint64_t> local_hits_{0};
+    std::atomic<uint64_t> redis_hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> invalidations_{0};
+};
@@ -0,0 +1,101 @@
+/**
+ *
+ *  ConnectionRegistry.h
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace server::realtime
+{
+/*
+ * user id -> refresh token id -> connection registry.
+ * The key space is split into independently locked shards so that connects, disconnects and keyspace lookups
+ * for different users never contend on a single lock. Every operation locks exactly one shard and is O(1).
+ */
+template <typename UserId, typename ConnectionPtr, std::size_t ShardCount = 64> class ConnectionRegistry
+{
+    static_assert((ShardCount & (ShardCount - 1)) == 0, "ShardCount must be a power of two");
+
+  public:
+    // Registers the connection and returns the one it replaced for the same refresh token, if any.
+    ConnectionPtr Insert(const UserId user_id, const std::string &refresh_token_id, ConnectionPtr conn)
+    {
+        auto &shard = ShardFor(user_id);
+        std::lock_guard lock(shard.mutex);
+        auto &slot = shard.connections[user_id][refresh_token_id];
+        std::swap(slot, conn);
+        return conn;
+    }
+
+    // Removes the entry only if it still refers to conn, so a replaced connection closing late cannot
+    // unregister its successor.
+    bool Erase(const UserId user_id, const std::string &refresh_token_id, const ConnectionPtr &conn)
+    {
+        auto &shard = ShardFor(user_id);
+        std::lock_guard lock(shard.mutex);
+        const auto user_it = shard.connections.find(user_id);
+        if (user_it == shard.connections.end())
+        {
+            return false;
+        }
+        const auto conn_it = user_it->second.find(refresh_token_id);
+        if (conn_it == user_it->second.end() || conn_it->second != conn)
+        {
+            return false;
+        }
+        user_it->second.erase(conn_it);
+        if (user_it->second.empty())
+        {
+            shard.connections.erase(user_it);
+        }
+        return true;
+    }
+
+    ConnectionPtr Find(const UserId user_id, const std::string &refresh_token_id) const
+    {
+        const auto &shard = ShardFor(user_id);
+        std::lock_guard lock(shard.mutex);
+        if (const auto user_it = shard.connections.find(user_id); user_it != shard.connections.end())
+        {
+            if (const auto conn_it = user_it->second.find(refresh_token_id); conn_it != user_it->second.end())
+            {
+                return conn_it->second;
+            }
+        }
+        return {};
+    }
+
+  private:
+    struct alignas(64) Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<UserId, std::unordered_map<std::string, ConnectionPtr>> connections;
+    };
+
+    static std::size_t ShardIndex(const UserId user_id)
+    {
+        // Fibonacci hashing: sequential ids land on different shards.
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(user_id) * 0x9E3779B97F4A7C15ull) >> 32) &
+               (ShardCount - 1);
+    }
+
+    Shard &ShardFor(const UserId user_id)
+    {
+        return shards_[ShardIndex(user_id)];
+    }
+
+    const Shard &ShardFor(const UserId user_id) const
+    {
+        return shards_[ShardIndex(user_id)];
+    }
+
+    std::array<Shard, ShardCount> shards_;
+};
+} // namespace server::realtime
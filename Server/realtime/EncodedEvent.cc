@@ -0,0 +1,74 @@
+/**
+ *
+ *  EncodedEvent.cc
+ *
+ */
+
+#include "EncodedEvent.h"
+#include "MsgPackCodec.h"
+#include "WebSocketFrame.h"
+
+#include <json/json.h>
+
+using namespace server::realtime;
+
+EncodedEvent::EncodedEvent(Json::Value event) : event_(std::move(event))
+{
+}
+
+EncodedEvent EncodedEvent::FromJsonText(std::string payload)
+{
+    EncodedEvent encoded;
+    encoded.json_payload_ = std::move(payload);
+    return encoded;
+}
+
+const std::string &EncodedEvent::Payload(const WireFormat format)
+{
+    if (format == WireFormat::kMsgPack)
+    {
+        if (!msgpack_payload_)
+        {
+            msgpack_payload_ = EncodeMsgPack(Event());
+            encoded_bytes_ += msgpack_payload_->size();
+        }
+        return *msgpack_payload_;
+    }
+
+    if (!json_payload_)
+    {
+        static const auto writer_builder = [] {
+            Json::StreamWriterBuilder builder;
+            builder["indentation"] = "";
+            return builder;
+        }();
+        json_payload_ = Json::writeString(writer_builder, Event());
+        encoded_bytes_ += json_payload_->size();
+    }
+    return *json_payload_;
+}
+
+const std::shared_ptr<std::string> &EncodedEvent::Frame(const WireFormat format)
+{
+    auto &frame = format == WireFormat::kMsgPack ? msgpack_frame_ : json_frame_;
+    if (!frame)
+    {
+        frame = MakeServerFrame(Payload(format), format == WireFormat::kMsgPack);
+        encoded_bytes_ += frame->size();
+    }
+    return frame;
+}
+
+const Json::Value &EncodedEvent::Event()
+{
+    if (!event_)
+    {
+        static const Json::CharReaderBuilder reader_builder;
+        const std::unique_ptr<Json::CharReader> reader(reader_builder.newCharReader());
+        Json::Value event;
+        std::string errs;
+        reader->parse(json_payload_->data(), json_payload_->data() + json_payload_->size(), &event, &errs);
+        event_ = std::move(event);
+    }
+    return *event_;
+}
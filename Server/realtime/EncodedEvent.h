@@ -0,0 +1,52 @@
+/**
+ *
+ *  EncodedEvent.h
+ *
+ */
+
+#pragma once
+
+#include <json/value.h>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace server::realtime
+{
+enum class WireFormat
+{
+    kJson,
+    kMsgPack
+};
+
+// An outgoing event that is encoded, and framed, at most once per wire format, however many connections it is
+// delivered to. Not thread-safe: one instance belongs to one delivery pass. The frames it hands out are immutable and
+// may be shared across threads.
+class EncodedEvent
+{
+  public:
+    explicit EncodedEvent(Json::Value event);
+    static EncodedEvent FromJsonText(std::string payload);
+
+    const std::string &Payload(WireFormat format);
+    // The complete WebSocket frame carrying Payload(format).
+    const std::shared_ptr<std::string> &Frame(WireFormat format);
+
+    // Bytes serialized or copied into frames so far, whatever the number of recipients.
+    std::size_t EncodedBytes() const
+    {
+        return encoded_bytes_;
+    }
+
+  private:
+    EncodedEvent() = default;
+    const Json::Value &Event();
+
+    std::optional<Json::Value> event_;
+    std::optional<std::string> json_payload_;
+    std::optional<std::string> msgpack_payload_;
+    std::shared_ptr<std::string> json_frame_;
+    std::shared_ptr<std::string> msgpack_frame_;
+    std::size_t encoded_bytes_{0};
+};
+} // namespace server::realtime
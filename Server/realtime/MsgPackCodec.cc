@@ -0,0 +1,414 @@
+/**
+ *
+ *  MsgPackCodec.cc
+ *
+ */
+
+#include "MsgPackCodec.h"
+
+#include <bit>
+#include <cstring>
+#include <format>
+
+using namespace server::realtime;
+
+namespace
+{
+constexpr std::size_t kMaxDepth{256};
+
+template <typename T> void AppendBigEndian(std::string &out, const T value)
+{
+    auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    if constexpr (std::endian::native == std::endian::little && sizeof(T) > 1)
+    {
+        bits = std::byteswap(bits);
+    }
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &bits, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+void AppendTagged(std::string &out, const unsigned char tag)
+{
+    out.push_back(static_cast<char>(tag));
+}
+
+void AppendLength(std::string &out, const std::size_t length, const unsigned char fix_tag, const std::size_t fix_max,
+                  const unsigned char tag8, const unsigned char tag16, const unsigned char tag32)
+{
+    if (length <= fix_max)
+    {
+        AppendTagged(out, static_cast<unsigned char>(fix_tag | length));
+    }
+    else if (tag8 != 0 && length <= UINT8_MAX)
+    {
+        AppendTagged(out, tag8);
+        AppendBigEndian(out, static_cast<uint8_t>(length));
+    }
+    else if (length <= UINT16_MAX)
+    {
+        AppendTagged(out, tag16);
+        AppendBigEndian(out, static_cast<uint16_t>(length));
+    }
+    else
+    {
+        AppendTagged(out, tag32);
+        AppendBigEndian(out, static_cast<uint32_t>(length));
+    }
+}
+
+void AppendString(std::string &out, const char *begin, const char *end)
+{
+    const auto length = static_cast<std::size_t>(end - begin);
+    AppendLength(out, length, 0xa0, 31, 0xd9, 0xda, 0xdb);
+    out.append(begin, length);
+}
+
+void AppendUnsigned(std::string &out, const uint64_t value)
+{
+    if (value <= 0x7f)
+    {
+        AppendTagged(out, static_cast<unsigned char>(value));
+    }
+    else if (value <= UINT8_MAX)
+    {
+        AppendTagged(out, 0xcc);
+        AppendBigEndian(out, static_cast<uint8_t>(value));
+    }
+    else if (value <= UINT16_MAX)
+    {
+        AppendTagged(out, 0xcd);
+        AppendBigEndian(out, static_cast<uint16_t>(value));
+    }
+    else if (value <= UINT32_MAX)
+    {
+        AppendTagged(out, 0xce);
+        AppendBigEndian(out, static_cast<uint32_t>(value));
+    }
+    else
+    {
+        AppendTagged(out, 0xcf);
+        AppendBigEndian(out, value);
+    }
+}
+
+void AppendSigned(std::string &out, const int64_t value)
+{
+    if (value >= 0)
+    {
+        AppendUnsigned(out, static_cast<uint64_t>(value));
+    }
+    else if (value >= -32)
+    {
+        AppendTagged(out, static_cast<unsigned char>(value));
+    }
+    else if (value >= INT8_MIN)
+    {
+        AppendTagged(out, 0xd0);
+        AppendBigEndian(out, static_cast<int8_t>(value));
+    }
+    else if (value >= INT16_MIN)
+    {
+        AppendTagged(out, 0xd1);
+        AppendBigEndian(out, static_cast<int16_t>(value));
+    }
+    else if (value >= INT32_MIN)
+    {
+        AppendTagged(out, 0xd2);
+        AppendBigEndian(out, static_cast<int32_t>(value));
+    }
+    else
+    {
+        AppendTagged(out, 0xd3);
+        AppendBigEndian(out, value);
+    }
+}
+
+void Encode(std::string &out, const Json::Value &value)
+{
+    switch (value.type())
+    {
+    case Json::nullValue:
+        AppendTagged(out, 0xc0);
+        break;
+    case Json::booleanValue:
+        AppendTagged(out, value.asBool() ? 0xc3 : 0xc2);
+        break;
+    case Json::intValue:
+        AppendSigned(out, value.asInt64());
+        break;
+    case Json::uintValue:
+        AppendUnsigned(out, value.asUInt64());
+        break;
+    case Json::realValue:
+        AppendTagged(out, 0xcb);
+        AppendBigEndian(out, std::bit_cast<uint64_t>(value.asDouble()));
+        break;
+    case Json::stringValue: {
+        const char *begin = nullptr;
+        const char *end = nullptr;
+        value.getString(&begin, &end);
+        AppendString(out, begin, end);
+        break;
+    }
+    case Json::arrayValue:
+        AppendLength(out, value.size(), 0x90, 15, 0, 0xdc, 0xdd);
+        for (const auto &element : value)
+        {
+            Encode(out, element);
+        }
+        break;
+    case Json::objectValue:
+        AppendLength(out, value.size(), 0x80, 15, 0, 0xde, 0xdf);
+        for (auto it = value.begin(); it != value.end(); ++it)
+        {
+            const char *end = nullptr;
+            const char *begin = it.memberName(&end);
+            AppendString(out, begin, end);
+            Encode(out, *it);
+        }
+        break;
+    }
+}
+
+class Decoder
+{
+  public:
+    explicit Decoder(const std::string_view data) : data_(data)
+    {
+    }
+
+    std::expected<Json::Value, std::string> DecodeDocument()
+    {
+        auto value = DecodeValue(0);
+        if (value && position_ != data_.size())
+        {
+            return std::unexpected("Trailing bytes after MessagePack document");
+        }
+        return value;
+    }
+
+  private:
+    template <typename T> std::expected<T, std::string> Read()
+    {
+        if (data_.size() - position_ < sizeof(T))
+        {
+            return std::unexpected("Truncated MessagePack document");
+        }
+        std::make_unsigned_t<T> bits;
+        std::memcpy(&bits, data_.data() + position_, sizeof(T));
+        position_ += sizeof(T);
+        if constexpr (std::endian::native == std::endian::little && sizeof(T) > 1)
+        {
+            bits = std::byteswap(bits);
+        }
+        return static_cast<T>(bits);
+    }
+
+    std::expected<std::string_view, std::string> ReadBytes(const std::size_t length)
+    {
+        if (data_.size() - position_ < length)
+        {
+            return std::unexpected("Truncated MessagePack document");
+        }
+        const auto bytes = data_.substr(position_, length);
+        position_ += length;
+        return bytes;
+    }
+
+    std::expected<Json::Value, std::string> DecodeString(const std::size_t length)
+    {
+        const auto bytes = ReadBytes(length);
+        if (!bytes)
+        {
+            return std::unexpected(bytes.error());
+        }
+        return Json::Value(bytes->data(), bytes->data() + bytes->size());
+    }
+
+    std::expected<Json::Value, std::string> DecodeArray(const std::size_t length, const std::size_t depth)
+    {
+        Json::Value array = Json::arrayValue;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            auto element = DecodeValue(depth + 1);
+            if (!element)
+            {
+                return element;
+            }
+            array.append(std::move(*element));
+        }
+        return array;
+    }
+
+    std::expected<Json::Value, std::string> DecodeMap(const std::size_t length, const std::size_t depth)
+    {
+        Json::Value object = Json::objectValue;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            auto key = DecodeValue(depth + 1);
+            if (!key)
+            {
+                return key;
+            }
+            if (!key->isString())
+            {
+                return std::unexpected("MessagePack map keys must be strings");
+            }
+            auto value = DecodeValue(depth + 1);
+            if (!value)
+            {
+                return value;
+            }
+            object[key->asString()] = std::move(*value);
+        }
+        return object;
+    }
+
+    template <typename T> std::expected<Json::Value, std::string> DecodeNumber()
+    {
+        const auto number = Read<T>();
+        if (!number)
+        {
+            return std::unexpected(number.error());
+        }
+        // Like Json::Reader, only integers beyond the signed range become uintValue.
+        if constexpr (std::is_signed_v<T>)
+        {
+            return Json::Value(static_cast<Json::Int64>(*number));
+        }
+        else if (static_cast<uint64_t>(*number) <= static_cast<uint64_t>(INT64_MAX))
+        {
+            return Json::Value(static_cast<Json::Int64>(*number));
+        }
+        else
+        {
+            return Json::Value(static_cast<Json::UInt64>(*number));
+        }
+    }
+
+    template <typename Bits, typename Real> std::expected<Json::Value, std::string> DecodeReal()
+    {
+        const auto bits = Read<Bits>();
+        if (!bits)
+        {
+            return std::unexpected(bits.error());
+        }
+        return Json::Value(static_cast<double>(std::bit_cast<Real>(*bits)));
+    }
+
+    template <typename LengthType, typename Fn> std::expected<Json::Value, std::string> WithLength(Fn &&fn)
+    {
+        const auto length = Read<LengthType>();
+        if (!length)
+        {
+            return std::unexpected(length.error());
+        }
+        return fn(static_cast<std::size_t>(*length));
+    }
+
+    std::expected<Json::Value, std::string> DecodeValue(const std::size_t depth)
+    {
+        if (depth > kMaxDepth)
+        {
+            return std::unexpected("MessagePack document is nested too deeply");
+        }
+        const auto tag_result = Read<uint8_t>();
+        if (!tag_result)
+        {
+            return std::unexpected(tag_result.error());
+        }
+        const auto tag = *tag_result;
+
+        const auto string = [this](const std::size_t length) { return DecodeString(length); };
+        const auto array = [this, depth](const std::size_t length) { return DecodeArray(length, depth); };
+        const auto map = [this, depth](const std::size_t length) { return DecodeMap(length, depth); };
+
+        if (tag <= 0x7f)
+        {
+            return Json::Value(static_cast<Json::Int>(tag));
+        }
+        if (tag >= 0xe0)
+        {
+            return Json::Value(static_cast<Json::Int>(static_cast<int8_t>(tag)));
+        }
+        if ((tag & 0xf0) == 0x80)
+        {
+            return map(tag & 0x0f);
+        }
+        if ((tag & 0xf0) == 0x90)
+        {
+            return array(tag & 0x0f);
+        }
+        if ((tag & 0xe0) == 0xa0)
+        {
+            return string(tag & 0x1f);
+        }
+
+        switch (tag)
+        {
+        case 0xc0:
+            return Json::Value(Json::nullValue);
+        case 0xc2:
+            return Json::Value(false);
+        case 0xc3:
+            return Json::Value(true);
+        case 0xc4:
+        case 0xd9:
+            return WithLength<uint8_t>(string);
+        case 0xc5:
+        case 0xda:
+            return WithLength<uint16_t>(string);
+        case 0xc6:
+        case 0xdb:
+            return WithLength<uint32_t>(string);
+        case 0xca:
+            return DecodeReal<uint32_t, float>();
+        case 0xcb:
+            return DecodeReal<uint64_t, double>();
+        case 0xcc:
+            return DecodeNumber<uint8_t>();
+        case 0xcd:
+            return DecodeNumber<uint16_t>();
+        case 0xce:
+            return DecodeNumber<uint32_t>();
+        case 0xcf:
+            return DecodeNumber<uint64_t>();
+        case 0xd0:
+            return DecodeNumber<int8_t>();
+        case 0xd1:
+            return DecodeNumber<int16_t>();
+        case 0xd2:
+            return DecodeNumber<int32_t>();
+        case 0xd3:
+            return DecodeNumber<int64_t>();
+        case 0xdc:
+            return WithLength<uint16_t>(array);
+        case 0xdd:
+            return WithLength<uint32_t>(array);
+        case 0xde:
+            return WithLength<uint16_t>(map);
+        case 0xdf:
+            return WithLength<uint32_t>(map);
+        default:
+            return std::unexpected(std::format("Unsupported MessagePack type 0x{:02x}", tag));
+        }
+    }
+
+    std::string_view data_;
+    std::size_t position_{0};
+};
+} // namespace
+
+std::string server::realtime::EncodeMsgPack(const Json::Value &value)
+{
+    std::string out;
+    out.reserve(256);
+    Encode(out, value);
+    return out;
+}
+
+std::expected<Json::Value, std::string> server::realtime::DecodeMsgPack(const std::string_view data)
+{
+    return Decoder(data).DecodeDocument();
+}
@@ -0,0 +1,20 @@
+/**
+ *
+ *  MsgPackCodec.h
+ *
+ */
+
+#pragma once
+
+#include <expected>
+#include <json/value.h>
+#include <string>
+#include <string_view>
+
+namespace server::realtime
+{
+// MessagePack <-> Json::Value transcoding for the binary WebSocket framing.
+// Reals are encoded as float64; integers decode to intValue unless they exceed the signed range, as with Json::Reader.
+std::string EncodeMsgPack(const Json::Value &value);
+std::expected<Json::Value, std::string> DecodeMsgPack(std::string_view data);
+} // namespace server::realtime
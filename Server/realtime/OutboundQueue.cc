@@ -0,0 +1,124 @@
+/**
+ *
+ *  OutboundQueue.cc
+ *
+ */
+
+#include "OutboundQueue.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace server::realtime;
+
+Json::Value OutboundQueueMetrics::ToJson() const
+{
+    Json::Value metrics;
+    metrics["queued_messages"] = static_cast<Json::Int64>(queued_messages.load(std::memory_order_relaxed));
+    metrics["queued_bytes"] = static_cast<Json::Int64>(queued_bytes.load(std::memory_order_relaxed));
+    metrics["coalesced"] = static_cast<Json::UInt64>(coalesced.load(std::memory_order_relaxed));
+    metrics["dropped"] = static_cast<Json::UInt64>(dropped.load(std::memory_order_relaxed));
+    metrics["overflow_disconnects"] = static_cast<Json::UInt64>(overflow_disconnects.load(std::memory_order_relaxed));
+    return metrics;
+}
+
+OutboundQueue::OutboundQueue(const Limits &limits, OutboundQueueMetrics &metrics, const std::size_t bytes_on_wire)
+    : limits_(limits), metrics_(metrics), handed_bytes_(bytes_on_wire)
+{
+}
+
+OutboundQueue::~OutboundQueue()
+{
+    Account(-static_cast<int64_t>(entries_.size()), -static_cast<int64_t>(queued_bytes_));
+}
+
+OutboundQueue::PushResult OutboundQueue::Push(Entry entry)
+{
+    std::lock_guard lock(mutex_);
+    if (overflowed_)
+    {
+        metrics_.dropped.fetch_add(1, std::memory_order_relaxed);
+        return PushResult::kDropped;
+    }
+    const auto is_ephemeral = entry.event_class == EventClass::kEphemeral;
+
+    if (is_ephemeral && !entry.coalesce_key.empty())
+    {
+        if (const auto it = std::ranges::find(entries_, entry.coalesce_key, &Entry::coalesce_key);
+            it != entries_.end())
+        {
+            Account(0, static_cast<int64_t>(entry.frame->size()) - static_cast<int64_t>(it->frame->size()));
+            *it = std::move(entry);
+            metrics_.coalesced.fetch_add(1, std::memory_order_relaxed);
+            return PushResult::kCoalesced;
+        }
+    }
+
+    while (!Fits(entry.frame->size()) && DropOldestEphemeral())
+    {
+    }
+    if (!Fits(entry.frame->size()))
+    {
+        if (is_ephemeral)
+        {
+            metrics_.dropped.fetch_add(1, std::memory_order_relaxed);
+            return PushResult::kDropped;
+        }
+        overflowed_ = true;
+        metrics_.overflow_disconnects.fetch_add(1, std::memory_order_relaxed);
+        return PushResult::kOverflow;
+    }
+
+    Account(1, static_cast<int64_t>(entry.frame->size()));
+    entries_.push_back(std::move(entry));
+    return PushResult::kQueued;
+}
+
+void OutboundQueue::RecordDirectWrite(const std::size_t frame_size)
+{
+    std::lock_guard lock(mutex_);
+    handed_bytes_ += frame_size;
+}
+
+bool OutboundQueue::TryScheduleRetry()
+{
+    std::lock_guard lock(mutex_);
+    return !std::exchange(retry_scheduled_, true);
+}
+
+void OutboundQueue::RetryDone()
+{
+    std::lock_guard lock(mutex_);
+    retry_scheduled_ = false;
+}
+
+std::size_t OutboundQueue::Depth() const
+{
+    std::lock_guard lock(mutex_);
+    return entries_.size();
+}
+
+bool OutboundQueue::Fits(const std::size_t frame_size) const
+{
+    return entries_.size() < limits_.max_messages && queued_bytes_ + frame_size <= limits_.max_bytes;
+}
+
+bool OutboundQueue::DropOldestEphemeral()
+{
+    const auto it = std::ranges::find(entries_, EventClass::kEphemeral, &Entry::event_class);
+    if (it == entries_.end())
+    {
+        return false;
+    }
+    Account(-1, -static_cast<int64_t>(it->frame->size()));
+    entries_.erase(it);
+    metrics_.dropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void OutboundQueue::Account(const int64_t messages, const int64_t bytes)
+{
+    queued_bytes_ = static_cast<std::size_t>(static_cast<int64_t>(queued_bytes_) + bytes);
+    metrics_.queued_messages.fetch_add(messages, std::memory_order_relaxed);
+    metrics_.queued_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
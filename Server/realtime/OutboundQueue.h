@@ -0,0 +1,127 @@
+/**
+ *
+ *  OutboundQueue.h
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <json/value.h>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace server::realtime
+{
+enum class EventClass
+{
+    // Chat messages and control events: never dropped, the connection is closed instead.
+    kDurable,
+    // Typing/presence style events: may be coalesced or dropped under pressure.
+    kEphemeral
+};
+
+struct OutboundQueueMetrics
+{
+    std::atomic<int64_t> queued_messages{0};
+    std::atomic<int64_t> queued_bytes{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> overflow_disconnects{0};
+
+    Json::Value ToJson() const;
+};
+
+/*
+ * Bounded per-connection send queue.
+ * Events are only handed to the socket while fewer than wire_window_bytes are still unsent, so a slow reader
+ * accumulates events here, under explicit caps, instead of growing the socket's unbounded output buffer.
+ * The unsent window is the difference between every byte handed to the socket and the socket's running total of
+ * bytes written, so frames written around the queue must be reported through RecordDirectWrite.
+ * All members are thread-safe.
+ */
+class OutboundQueue
+{
+  public:
+    struct Limits
+    {
+        std::size_t max_bytes;
+        std::size_t max_messages;
+        std::size_t wire_window_bytes;
+    };
+
+    struct Entry
+    {
+        // Complete WebSocket frame, usually shared with every other recipient of the event.
+        std::shared_ptr<std::string> frame;
+        EventClass event_class{EventClass::kDurable};
+        // Ephemeral entries with the same non-empty key replace each other while queued.
+        std::string coalesce_key;
+    };
+
+    enum class PushResult
+    {
+        kQueued,
+        kCoalesced,
+        kDropped,
+        // A durable event does not fit even after shedding ephemeral ones: the consumer is too slow and should be
+        // disconnected. Reported once; every later push is dropped.
+        kOverflow
+    };
+
+    // bytes_on_wire is the socket's running total of bytes written when the queue is created, e.g. the upgrade
+    // response.
+    OutboundQueue(const Limits &limits, OutboundQueueMetrics &metrics, std::size_t bytes_on_wire);
+    ~OutboundQueue();
+
+    // Applies the slow-consumer policy in order: coalesce with a queued ephemeral event of the same key, drop the
+    // oldest queued ephemeral events to make room, drop the incoming event if it is ephemeral, otherwise overflow.
+    PushResult Push(Entry entry);
+
+    // Hands queued entries to send(entry) while the unsent window allows it. bytes_on_wire is the socket's running
+    // total of bytes written. Returns true if entries remain queued.
+    template <typename SendFn> bool Drain(const std::size_t bytes_on_wire, SendFn &&send)
+    {
+        std::lock_guard lock(mutex_);
+        // More bytes were written than handed: some write went unreported (e.g. a frame Drogon sends on its own).
+        // Treat it as flushed so the error cannot accumulate into a window that never fills.
+        handed_bytes_ = std::max(handed_bytes_, bytes_on_wire);
+        while (!entries_.empty() && handed_bytes_ - bytes_on_wire < limits_.wire_window_bytes)
+        {
+            auto entry = std::move(entries_.front());
+            entries_.pop_front();
+            Account(-1, -static_cast<int64_t>(entry.frame->size()));
+            handed_bytes_ += entry.frame->size();
+            send(entry);
+        }
+        return !entries_.empty();
+    }
+
+    // Counts a frame written to the socket without going through the queue towards the unsent window.
+    void RecordDirectWrite(std::size_t frame_size);
+
+    // Returns true if the caller should schedule a retry drain; at most one retry is pending at a time.
+    bool TryScheduleRetry();
+    void RetryDone();
+
+    std::size_t Depth() const;
+
+  private:
+    bool Fits(std::size_t frame_size) const;
+    bool DropOldestEphemeral();
+    void Account(int64_t messages, int64_t bytes);
+
+    const Limits limits_;
+    OutboundQueueMetrics &metrics_;
+
+    mutable std::mutex mutex_;
+    std::deque<Entry> entries_;
+    std::size_t queued_bytes_{0};
+    std::size_t handed_bytes_{0};
+    bool retry_scheduled_{false};
+    bool overflowed_{false};
+};
+} // namespace server::realtime
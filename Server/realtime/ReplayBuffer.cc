@@ -0,0 +1,80 @@
+/**
+ *
+ *  ReplayBuffer.cc
+ *
+ */
+
+#include "ReplayBuffer.h"
+
+#include <algorithm>
+
+using namespace server::realtime;
+
+ReplayBuffer::ReplayBuffer(const std::size_t events_per_room) : events_per_room_(events_per_room)
+{
+}
+
+void ReplayBuffer::Record(const RoomId room_id, const Sequence seq, std::string json_payload)
+{
+    if (events_per_room_ == 0)
+    {
+        return;
+    }
+    std::lock_guard lock(mutex_);
+    auto &events = rooms_[room_id];
+    const auto position =
+        std::ranges::lower_bound(events, seq, std::less{}, [](const Event &event) { return event.seq; });
+    if (position != events.end() && position->seq == seq)
+    {
+        return;
+    }
+    if (position == events.begin() && events.size() == events_per_room_)
+    {
+        // Older than everything retained: recording it would evict it right away.
+        return;
+    }
+    events.insert(position, Event{seq, std::move(json_payload)});
+    if (events.size() > events_per_room_)
+    {
+        events.pop_front();
+    }
+}
+
+std::optional<std::vector<std::string>> ReplayBuffer::EventsAfter(const RoomId room_id, const Sequence last_seq) const
+{
+    std::lock_guard lock(mutex_);
+    const auto room_it = rooms_.find(room_id);
+    if (room_it == rooms_.end() || room_it->second.empty())
+    {
+        return std::nullopt;
+    }
+    const auto &events = room_it->second;
+    if (last_seq >= events.back().seq)
+    {
+        return std::vector<std::string>{};
+    }
+    if (events.front().seq > last_seq + 1)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<std::string> missed;
+    auto expected_seq = last_seq + 1;
+    const auto first =
+        std::ranges::lower_bound(events, expected_seq, std::less{}, [](const Event &event) { return event.seq; });
+    for (auto it = first; it != events.end(); ++it, ++expected_seq)
+    {
+        if (it->seq != expected_seq)
+        {
+            return std::nullopt;
+        }
+        missed.push_back(it->json_payload);
+    }
+    return missed;
+}
+
+void ReplayBuffer::Drop(const RoomId room_id)
+{
+    std::lock_guard lock(mutex_);
+    rooms_.erase(room_id);
+}
@@ -0,0 +1,53 @@
+/**
+ *
+ *  ReplayBuffer.h
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace server::realtime
+{
+/*
+ * Bounded per-room history of recent sequenced events, kept as JSON text.
+ * A reconnecting client names the last sequence it applied and gets the events it missed, provided that every one of
+ * them is still held contiguously. Events may be recorded slightly out of order (local and relayed deliveries race),
+ * so the buffer stays sorted and holes are detected when replaying rather than when recording.
+ */
+class ReplayBuffer
+{
+  public:
+    using RoomId = int32_t;
+    using Sequence = uint64_t;
+
+    explicit ReplayBuffer(std::size_t events_per_room);
+
+    void Record(RoomId room_id, Sequence seq, std::string json_payload);
+
+    // Events of the room with a sequence above last_seq, in order. Empty when the client is up to date and
+    // std::nullopt when the gap cannot be served from memory and the client has to resynchronize.
+    std::optional<std::vector<std::string>> EventsAfter(RoomId room_id, Sequence last_seq) const;
+
+    // Forgets the room's history, e.g. once this node stops receiving the room's events.
+    void Drop(RoomId room_id);
+
+  private:
+    struct Event
+    {
+        Sequence seq;
+        std::string json_payload;
+    };
+
+    std::size_t events_per_room_;
+    mutable std::mutex mutex_;
+    std::unordered_map<RoomId, std::deque<Event>> rooms_;
+};
+} // namespace server::realtime
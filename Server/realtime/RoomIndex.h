@@ -0,0 +1,183 @@
+/**
+ *
+ *  RoomIndex.h
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace server::realtime
+{
+/*
+ * Room -> live connections index used by the WebSocket fan-out.
+ * Members of a room are grouped by owner (the IO loop of the connection) and kept in contiguous vectors, so that a
+ * broadcast is a linear walk without any per-recipient lookup and can hand each owner its whole batch at once.
+ * The position map is only touched on join/leave to allow O(1) swap-and-pop removal.
+ * Rooms are split into independently locked shards, like ConnectionRegistry's users, so joins, leaves and broadcasts
+ * of different rooms never contend on a single lock.
+ */
+template <typename RoomId, typename OwnerId, typename ConnectionPtr, std::size_t ShardCount = 64> class RoomIndex
+{
+    static_assert((ShardCount & (ShardCount - 1)) == 0, "ShardCount must be a power of two");
+
+  public:
+    void Add(const RoomId room_id, const OwnerId owner, const ConnectionPtr &conn)
+    {
+        auto &shard = ShardFor(room_id);
+        std::unique_lock lock(shard.mutex);
+        auto &room = shard.rooms[room_id];
+        if (room.positions.contains(conn))
+        {
+            return;
+        }
+        auto group_it = std::ranges::find(room.groups, owner, &Group::owner);
+        if (group_it == room.groups.end())
+        {
+            group_it = room.groups.insert(room.groups.end(), Group{owner, {}});
+        }
+        room.positions.emplace(conn, Position{owner, group_it->members.size()});
+        group_it->members.push_back(conn);
+        ++room.member_count;
+    }
+
+    // Returns the number of members left in the room.
+    std::size_t Remove(const RoomId room_id, const ConnectionPtr &conn)
+    {
+        return Remove(room_id, conn, [] {});
+    }
+
+    // Same, and invokes on_empty when conn was the room's last member. on_empty runs under the room's lock, so a
+    // concurrent Add of the room happens either before it, and on_empty is not invoked, or after it returns.
+    // on_empty must not call into this index.
+    template <typename OnEmpty> std::size_t Remove(const RoomId room_id, const ConnectionPtr &conn, OnEmpty &&on_empty)
+    {
+        auto &shard = ShardFor(room_id);
+        std::unique_lock lock(shard.mutex);
+        const auto room_it = shard.rooms.find(room_id);
+        if (room_it == shard.rooms.end())
+        {
+            return 0;
+        }
+        auto &room = room_it->second;
+        const auto position_it = room.positions.find(conn);
+        if (position_it == room.positions.end())
+        {
+            return room.member_count;
+        }
+        const auto [owner, index] = position_it->second;
+        room.positions.erase(position_it);
+        const auto group_it = std::ranges::find(room.groups, owner, &Group::owner);
+        auto &members = group_it->members;
+        if (index != members.size() - 1)
+        {
+            members[index] = std::move(members.back());
+            room.positions[members[index]].index = index;
+        }
+        members.pop_back();
+        if (members.empty())
+        {
+            room.groups.erase(group_it);
+        }
+        if (--room.member_count == 0)
+        {
+            shard.rooms.erase(room_it);
+            on_empty();
+            return 0;
+        }
+        return room.member_count;
+    }
+
+    // Invokes fn for every live connection of the room and returns the number of recipients.
+    // fn must not add or remove members of this index.
+    template <typename Fn> std::size_t ForEachMember(const RoomId room_id, Fn &&fn) const
+    {
+        return ForEachOwner(room_id, [&fn](OwnerId, const std::span<const ConnectionPtr> members) {
+            for (const auto &conn : members)
+            {
+                fn(conn);
+            }
+        });
+    }
+
+    // Invokes fn(owner, members) once per owner having members in the room and returns the number of recipients.
+    // fn must not add or remove members of this index.
+    template <typename Fn> std::size_t ForEachOwner(const RoomId room_id, Fn &&fn) const
+    {
+        const auto &shard = ShardFor(room_id);
+        std::shared_lock lock(shard.mutex);
+        const auto room_it = shard.rooms.find(room_id);
+        if (room_it == shard.rooms.end())
+        {
+            return 0;
+        }
+        for (const auto &group : room_it->second.groups)
+        {
+            fn(group.owner, std::span<const ConnectionPtr>(group.members));
+        }
+        return room_it->second.member_count;
+    }
+
+    std::size_t MemberCount(const RoomId room_id) const
+    {
+        const auto &shard = ShardFor(room_id);
+        std::shared_lock lock(shard.mutex);
+        const auto room_it = shard.rooms.find(room_id);
+        return room_it == shard.rooms.end() ? 0 : room_it->second.member_count;
+    }
+
+  private:
+    struct Group
+    {
+        OwnerId owner;
+        std::vector<ConnectionPtr> members;
+    };
+
+    struct Position
+    {
+        OwnerId owner;
+        std::size_t index;
+    };
+
+    struct Room
+    {
+        // Few owners (one per IO loop), so a vector beats a map.
+        std::vector<Group> groups;
+        std::unordered_map<ConnectionPtr, Position> positions;
+        std::size_t member_count{0};
+    };
+
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<RoomId, Room> rooms;
+    };
+
+    static std::size_t ShardIndex(const RoomId room_id)
+    {
+        // Fibonacci hashing: sequential ids land on different shards.
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(room_id) * 0x9E3779B97F4A7C15ull) >> 32) &
+               (ShardCount - 1);
+    }
+
+    Shard &ShardFor(const RoomId room_id)
+    {
+        return shards_[ShardIndex(room_id)];
+    }
+
+    const Shard &ShardFor(const RoomId room_id) const
+    {
+        return shards_[ShardIndex(room_id)];
+    }
+
+    std::array<Shard, ShardCount> shards_;
+};
+} // namespace server::realtime
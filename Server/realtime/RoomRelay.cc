@@ -0,0 +1,123 @@
+/**
+ *
+ *  RoomRelay.cc
+ *
+ */
+
+#include "RoomRelay.h"
+
+#include <charconv>
+#include <drogon/utils/Utilities.h>
+#include <format>
+#include <trantor/net/EventLoop.h>
+#include <trantor/utils/Logger.h>
+
+using namespace drogon;
+using namespace server::realtime;
+
+namespace
+{
+constexpr std::string_view kChannelPrefix{"chat:room:"};
+constexpr char kHeaderSeparator{'\n'};
+} // namespace
+
+RoomRelay::RoomRelay(nosql::RedisClientPtr redis_client, std::shared_ptr<nosql::RedisSubscriber> subscriber,
+                     DeliverCallback deliver)
+    : redis_client_(std::move(redis_client)), subscriber_(std::move(subscriber)), deliver_(std::move(deliver)),
+      node_id_(utils::getUuid())
+{
+}
+
+std::string RoomRelay::ChannelName(const RoomId room_id)
+{
+    return std::format("{}{}", kChannelPrefix, room_id);
+}
+
+void RoomRelay::AddLocalMember(const RoomId room_id)
+{
+    std::lock_guard lock(local_members_mutex_);
+    if (++local_members_[room_id] == 1)
+    {
+        subscriber_->subscribe(ChannelName(room_id), [this](const std::string &channel, const std::string &message) {
+            OnMessage(channel, message);
+        });
+    }
+}
+
+void RoomRelay::RemoveLocalMember(const RoomId room_id)
+{
+    std::lock_guard lock(local_members_mutex_);
+    const auto it = local_members_.find(room_id);
+    if (it == local_members_.end())
+    {
+        return;
+    }
+    if (--it->second == 0)
+    {
+        local_members_.erase(it);
+        subscriber_->unsubscribe(ChannelName(room_id));
+    }
+}
+
+void RoomRelay::Publish(const RoomId room_id, const Sequence seq, const std::string &payload,
+                        const std::string &coalesce_key) const
+{
+    // <node id>\n<seq>\n<coalesce key>\n<payload>
+    auto frame = std::format("{0}{1}{2}{1}{3}{1}", node_id_, kHeaderSeparator, seq, coalesce_key);
+    frame.append(payload);
+    redis_client_->execCommandAsync(
+        [](const nosql::RedisResult &) {}, [](const nosql::RedisException &e) { LOG_ERROR << e.what(); },
+        "PUBLISH %s %b", ChannelName(room_id).c_str(), frame.data(), frame.size());
+}
+
+void RoomRelay::OnMessage(const std::string &channel, const std::string &message)
+{
+    const auto node_separator = message.find(kHeaderSeparator);
+    if (node_separator == std::string::npos || std::string_view(message).substr(0, node_separator) == node_id_)
+    {
+        return;
+    }
+    Sequence seq{};
+    const auto frame_end = message.data() + message.size();
+    const auto [seq_end, seq_ec] = std::from_chars(message.data() + node_separator + 1, frame_end, seq);
+    if (seq_ec != std::errc{} || seq_end == frame_end || *seq_end != kHeaderSeparator)
+    {
+        LOG_ERROR << "Invalid relay frame on " << channel;
+        return;
+    }
+    const auto key_begin = static_cast<std::size_t>(seq_end + 1 - message.data());
+    const auto key_separator = message.find(kHeaderSeparator, key_begin);
+    if (key_separator == std::string::npos)
+    {
+        LOG_ERROR << "Invalid relay frame on " << channel;
+        return;
+    }
+
+    RoomId room_id{};
+    const auto id_begin = channel.data() + kChannelPrefix.size();
+    if (const auto [_, ec] = std::from_chars(id_begin, channel.data() + channel.size(), room_id); ec != std::errc{})
+    {
+        LOG_ERROR << "Invalid relay channel " << channel;
+        return;
+    }
+
+    std::lock_guard lock(pending_mutex_);
+    pending_.push_back(Event{room_id, seq, message.substr(key_begin, key_separator - key_begin),
+                             message.substr(key_separator + 1)});
+    if (!flush_scheduled_)
+    {
+        flush_scheduled_ = true;
+        trantor::EventLoop::getEventLoopOfCurrentThread()->queueInLoop([this] { Flush(); });
+    }
+}
+
+void RoomRelay::Flush()
+{
+    std::vector<Event> batch;
+    {
+        std::lock_guard lock(pending_mutex_);
+        batch.swap(pending_);
+        flush_scheduled_ = false;
+    }
+    deliver_(std::move(batch));
+}
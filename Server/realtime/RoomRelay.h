@@ -0,0 +1,72 @@
+/**
+ *
+ *  RoomRelay.h
+ *
+ */
+
+#pragma once
+
+#include <drogon/nosql/RedisClient.h>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace server::realtime
+{
+/*
+ * Cross-node room fan-out over Redis pub/sub.
+ * Every room with at least one local member is subscribed on its own channel, so a node only receives traffic for
+ * rooms it can deliver. Published frames are prefixed with the node id, the event's room sequence and its coalesce
+ * key; frames carrying our own id are dropped, since the publishing node has already delivered them locally.
+ * Frames received within one event loop iteration are handed to the delivery callback as one batch, in arrival order.
+ */
+class RoomRelay
+{
+  public:
+    using RoomId = int32_t;
+    // Room event sequence, 0 for events that are not sequenced.
+    using Sequence = uint64_t;
+    struct Event
+    {
+        RoomId room_id;
+        Sequence seq;
+        // Non-empty for ephemeral events.
+        std::string coalesce_key;
+        std::string payload;
+    };
+    using DeliverCallback = std::function<void(std::vector<Event> events)>;
+
+    RoomRelay(drogon::nosql::RedisClientPtr redis_client, std::shared_ptr<drogon::nosql::RedisSubscriber> subscriber,
+              DeliverCallback deliver);
+
+    // Reference-counted per room: the channel is subscribed on the first local member and released on the last.
+    void AddLocalMember(RoomId room_id);
+    void RemoveLocalMember(RoomId room_id);
+
+    void Publish(RoomId room_id, Sequence seq, const std::string &payload,
+                 const std::string &coalesce_key = std::string()) const;
+
+    const std::string &NodeId() const
+    {
+        return node_id_;
+    }
+
+  private:
+    static std::string ChannelName(RoomId room_id);
+    void OnMessage(const std::string &channel, const std::string &message);
+    void Flush();
+
+    drogon::nosql::RedisClientPtr redis_client_;
+    std::shared_ptr<drogon::nosql::RedisSubscriber> subscriber_;
+    DeliverCallback deliver_;
+    std::string node_id_;
+
+    std::mutex local_members_mutex_;
+    std::unordered_map<RoomId, std::size_t> local_members_;
+
+    std::mutex pending_mutex_;
+    std::vector<Event> pending_;
+    bool flush_scheduled_{false};
+};
+} // namespace server::realtime
@@ -0,0 +1,41 @@
+/**
+ *
+ *  RoomThrottle.cc
+ *
+ */
+
+#include "RoomThrottle.h"
+
+#include <algorithm>
+
+using namespace server::realtime;
+
+RoomThrottle::RoomThrottle(const double events_per_second, const double burst)
+    : events_per_second_(events_per_second), burst_(std::max(burst, 1.0))
+{
+}
+
+bool RoomThrottle::TryAcquire(const RoomId room_id, const Clock::time_point now)
+{
+    std::lock_guard lock(mutex_);
+    auto [it, inserted] = buckets_.try_emplace(room_id, Bucket{burst_, now});
+    auto &bucket = it->second;
+    if (!inserted)
+    {
+        const std::chrono::duration<double> elapsed = now - bucket.last_refill;
+        bucket.tokens = std::min(burst_, bucket.tokens + elapsed.count() * events_per_second_);
+        bucket.last_refill = now;
+    }
+    if (bucket.tokens < 1.0)
+    {
+        return false;
+    }
+    bucket.tokens -= 1.0;
+    return true;
+}
+
+void RoomThrottle::Drop(const RoomId room_id)
+{
+    std::lock_guard lock(mutex_);
+    buckets_.erase(room_id);
+}
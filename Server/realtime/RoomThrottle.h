@@ -0,0 +1,45 @@
+/**
+ *
+ *  RoomThrottle.h
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace server::realtime
+{
+/*
+ * Per-room token bucket bounding how many ephemeral events a room fans out per second, whoever sends them.
+ * A single chatty client therefore cannot multiply its traffic across every member of a large room.
+ * Buckets are local to the node: each node admits its own members' events at the full rate and relays them to the
+ * others unthrottled, so a room spread over N nodes fans out up to N times the configured rate.
+ */
+class RoomThrottle
+{
+  public:
+    using RoomId = int32_t;
+    using Clock = std::chrono::steady_clock;
+
+    RoomThrottle(double events_per_second, double burst);
+
+    bool TryAcquire(RoomId room_id, Clock::time_point now = Clock::now());
+    void Drop(RoomId room_id);
+
+  private:
+    struct Bucket
+    {
+        double tokens;
+        Clock::time_point last_refill;
+    };
+
+    const double events_per_second_;
+    const double burst_;
+    std::mutex mutex_;
+    std::unordered_map<RoomId, Bucket> buckets_;
+};
+} // namespace server::realtime
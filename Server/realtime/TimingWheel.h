@@ -0,0 +1,90 @@
+/**
+ *
+ *  TimingWheel.h
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace server::realtime
+{
+/*
+ * Hashed timing wheel: entries are bucketed by due tick modulo the slot count, with a round counter for delays longer
+ * than one revolution. Scheduling is O(1) and a tick only visits the entries of one slot, so thousands of idle
+ * connections cost nothing between their deadlines. Entries are never cancelled or moved: an entry whose owner saw
+ * activity is simply rescheduled for its remaining delay when its slot comes up.
+ * Not thread-safe: a wheel belongs to one event loop.
+ */
+template <typename Entry> class TimingWheel
+{
+  public:
+    explicit TimingWheel(const std::size_t slot_count) : slots_(slot_count)
+    {
+    }
+
+    // Schedules entry to expire after delay_ticks (at least 1) ticks.
+    void Schedule(uint64_t delay_ticks, Entry entry)
+    {
+        delay_ticks = delay_ticks == 0 ? 1 : delay_ticks;
+        const auto due_tick = current_tick_ + delay_ticks;
+        slots_[due_tick % slots_.size()].push_back({(delay_ticks - 1) / slots_.size(), std::move(entry)});
+        ++size_;
+    }
+
+    // Advances by one tick and calls fn(entry) for every entry due. fn returns the delay in ticks after which the
+    // entry is due again, or 0 to drop it.
+    template <typename Fn> void Tick(Fn &&fn)
+    {
+        ++current_tick_;
+        auto &slot = slots_[current_tick_ % slots_.size()];
+        std::vector<Slotted> due;
+        for (std::size_t i = 0; i < slot.size();)
+        {
+            if (slot[i].rounds > 0)
+            {
+                --slot[i].rounds;
+                ++i;
+                continue;
+            }
+            due.push_back(std::move(slot[i]));
+            if (i + 1 != slot.size())
+            {
+                slot[i] = std::move(slot.back());
+            }
+            slot.pop_back();
+        }
+        size_ -= due.size();
+        for (auto &slotted : due)
+        {
+            if (const auto delay_ticks = fn(slotted.entry); delay_ticks != 0)
+            {
+                Schedule(delay_ticks, std::move(slotted.entry));
+            }
+        }
+    }
+
+    uint64_t CurrentTick() const
+    {
+        return current_tick_;
+    }
+
+    std::size_t Size() const
+    {
+        return size_;
+    }
+
+  private:
+    struct Slotted
+    {
+        uint64_t rounds;
+        Entry entry;
+    };
+
+    std::vector<std::vector<Slotted>> slots_;
+    uint64_t current_tick_{0};
+    std::size_t size_{0};
+};
+} // namespace server::realtime
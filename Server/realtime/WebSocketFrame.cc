@@ -0,0 +1,54 @@
+/**
+ *
+ *  WebSocketFrame.cc
+ *
+ */
+
+#include "WebSocketFrame.h"
+
+#include <cstdint>
+
+using namespace server::realtime;
+
+namespace
+{
+constexpr uint8_t kFinalFragment{0x80};
+constexpr uint8_t kTextOpcode{0x1};
+constexpr uint8_t kBinaryOpcode{0x2};
+constexpr uint8_t kLength16{126};
+constexpr uint8_t kLength64{127};
+
+std::size_t LengthBytes(const uint64_t size)
+{
+    return size < kLength16 ? 0 : size <= UINT16_MAX ? 2 : 8;
+}
+} // namespace
+
+std::shared_ptr<std::string> server::realtime::MakeServerFrame(const std::string_view payload, const bool binary)
+{
+    const auto size = static_cast<uint64_t>(payload.size());
+    const auto length_bytes = LengthBytes(size);
+
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(2 + length_bytes + payload.size());
+    frame->push_back(static_cast<char>(kFinalFragment | (binary ? kBinaryOpcode : kTextOpcode)));
+    if (length_bytes == 0)
+    {
+        frame->push_back(static_cast<char>(size));
+    }
+    else
+    {
+        frame->push_back(static_cast<char>(length_bytes == 2 ? kLength16 : kLength64));
+        for (auto shift = static_cast<int>(length_bytes - 1) * 8; shift >= 0; shift -= 8)
+        {
+            frame->push_back(static_cast<char>((size >> shift) & 0xFF));
+        }
+    }
+    frame->append(payload);
+    return frame;
+}
+
+std::size_t server::realtime::ServerFrameSize(const std::size_t payload_size)
+{
+    return 2 + LengthBytes(payload_size) + payload_size;
+}
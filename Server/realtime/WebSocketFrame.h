@@ -0,0 +1,22 @@
+/**
+ *
+ *  WebSocketFrame.h
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace server::realtime
+{
+// Builds a complete, unmasked server-to-client WebSocket frame (RFC 6455, section 5.2) carrying the payload in a single
+// final fragment. Server frames are byte-identical for every recipient, so one frame can be written to any number of
+// connections without being copied or re-framed.
+std::shared_ptr<std::string> MakeServerFrame(std::string_view payload, bool binary);
+
+// Size of the server frame carrying a payload of payload_size bytes, e.g. one written by WebSocketConnection::send.
+std::size_t ServerFrameSize(std::size_t payload_size);
+} // namespace server::realtime
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace server::utilities
+{
+/*
+ * Fixed-size Bloom filter over 64-bit hashes, sized for an expected number of elements and false positive rate.
+ * MayContain() is lock-free and may run concurrently with Add(); elements cannot be removed, so owners rebuild a fresh
+ * filter from their exact set when it has to shrink.
+ */
+class BloomFilter
+{
+  public:
+    BloomFilter(const std::size_t expected_elements, const double false_positive_rate)
+    {
+        // m = -n ln(p) / ln(2)^2 bits and k = m / n ln(2) hash functions minimize the false positive rate.
+        const auto n = static_cast<double>(std::max<std::size_t>(expected_elements, 1));
+        const auto bits = std::ceil(-n * std::log(false_positive_rate) / (std::log(2.0) * std::log(2.0)));
+        words_ = std::vector<std::atomic<uint64_t>>(std::max<std::size_t>(static_cast<std::size_t>(bits) / 64 + 1, 1));
+        hash_count_ = std::clamp<std::size_t>(static_cast<std::size_t>(std::round(bits / n * std::log(2.0))), 1, 16);
+    }
+
+    void Add(const uint64_t hash)
+    {
+        ForEachBit(hash, [this](const std::size_t word, const uint64_t mask) {
+            words_[word].fetch_or(mask, std::memory_order_relaxed);
+            return true;
+        });
+    }
+
+    bool MayContain(const uint64_t hash) const
+    {
+        return ForEachBit(hash, [this](const std::size_t word, const uint64_t mask) {
+            return (words_[word].load(std::memory_order_relaxed) & mask) != 0;
+        });
+    }
+
+  private:
+    // Double hashing: the k probes are h1 + i * h2, with h2 odd so that they never collapse onto one bit.
+    template <typename Fn> bool ForEachBit(const uint64_t hash, Fn &&fn) const
+    {
+        const auto bit_count = words_.size() * 64;
+        const uint64_t h1 = hash;
+        const uint64_t h2 = (hash >> 32 | hash << 32) | 1;
+        for (std::size_t i = 0; i < hash_count_; ++i)
+        {
+            const auto bit = (h1 + i * h2) % bit_count;
+            if (!fn(bit / 64, uint64_t{1} << (bit % 64)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::atomic<uint64_t>> words_;
+    std::size_t hash_count_{};
+};
+} // namespace server::utilities
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <botan/hash.h>
+#include <botan/mem_ops.h>
+#include <jwt-cpp/jwt.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace server::utilities
+{
+/*
+ * HS256 as a jwt-cpp algorithm, usable with jwt::create().sign() and jwt::verify().allow_algorithm().
+ * The SHA-256 states that have absorbed the key XOR ipad and the key XOR opad are computed once. Each sign or verify
+ * clones them, so it only hashes the message and the inner digest, and it allocates nothing for the digests.
+ * Copies share the precomputed states, which are never modified, so one instance may be used from any thread.
+ */
+class HmacSha256
+{
+  public:
+    explicit HmacSha256(const std::string_view secret)
+    {
+        auto hash = Botan::HashFunction::create_or_throw("SHA-256");
+        const auto block_size = hash->hash_block_size();
+        Botan::secure_vector<uint8_t> key(secret.begin(), secret.end());
+        if (key.size() > block_size)
+        {
+            key = hash->process(key);
+        }
+        key.resize(block_size, 0);
+
+        for (auto &byte : key)
+        {
+            byte ^= 0x36;
+        }
+        hash->update(key);
+        inner_ = hash->copy_state();
+        hash->clear();
+
+        for (auto &byte : key)
+        {
+            byte ^= 0x36 ^ 0x5c;
+        }
+        hash->update(key);
+        outer_ = hash->copy_state();
+    }
+
+    std::string sign(const std::string &data, std::error_code &ec) const
+    {
+        ec.clear();
+        const auto mac = Compute(data);
+        return {mac.begin(), mac.end()};
+    }
+
+    void verify(const std::string &data, const std::string &signature, std::error_code &ec) const
+    {
+        ec.clear();
+        const auto mac = Compute(data);
+        if (signature.size() != mac.size() ||
+            !Botan::constant_time_compare(mac.data(), reinterpret_cast<const uint8_t *>(signature.data()), mac.size()))
+        {
+            ec = jwt::error::signature_verification_error::invalid_signature;
+        }
+    }
+
+    std::string name() const
+    {
+        return "HS256";
+    }
+
+  private:
+    using Digest = std::array<uint8_t, 32>;
+
+    Digest Compute(const std::string_view data) const
+    {
+        Digest digest;
+        const auto inner = inner_->copy_state();
+        inner->update(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+        inner->final(digest.data());
+        const auto outer = outer_->copy_state();
+        outer->update(digest.data(), digest.size());
+        outer->final(digest.data());
+        return digest;
+    }
+
+    std::shared_ptr<const Botan::HashFunction> inner_;
+    std::shared_ptr<const Botan::HashFunction> outer_;
+};
+} // namespace server::utilities
@@ -17,7 +17,8 @@ enum class HttpErrorCode
     // system-defined error codes
     kDatabaseError,
     kCacheDatabaseError,
-    kInternalServerError
+    kInternalServerError,
+    kServiceUnavailableError
 };
 
 namespace utilities
@@ -84,6 +85,10 @@ template <HttpErrorCode error_code, typename... Args> HttpResponsePtr NewHttpErr
     {
         return NewHttpErrorResponse(k500InternalServerError, error_message, std::forward<Args>(args)...);
     }
+    else if constexpr (error_code == HttpErrorCode::kServiceUnavailableError)
+    {
+        return NewHttpErrorResponse(k503ServiceUnavailable, error_message, std::forward<Args>(args)...);
+    }
     else
     {
         static_assert(false, "Invalid error code");
@@ -142,6 +147,10 @@ HttpResponsePtr NewJsonErrorResponse(Args &&...args)
     {
         status_code = k500InternalServerError;
     }
+    else if constexpr (error_code == HttpErrorCode::kServiceUnavailableError)
+    {
+        status_code = k503ServiceUnavailable;
+    }
     else
     {
         static_assert(false, "Invalid error code");
@@ -184,6 +193,8 @@ consteval const char *HttpErrorCodeToString(HttpErrorCode error_code)
         return "Cache database error";
     case HttpErrorCode::kInternalServerError:
         return "Internal server error";
+    case HttpErrorCode::kServiceUnavailableError:
+        return "Service unavailable";
     default:
         throw std::invalid_argument("Invalid error code");
     }
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace server::utilities
+{
+/*
+ * Bounded least-recently-used map whose entries also carry an expiry time.
+ * Expired entries are dropped lazily when looked up, or evicted like any other once they reach the cold end.
+ * Not thread-safe: callers shard and lock around it.
+ */
+template <typename Key, typename Value, typename Clock = std::chrono::steady_clock> class LruCache
+{
+  public:
+    using TimePoint = typename Clock::time_point;
+
+    explicit LruCache(const std::size_t capacity) : capacity_(capacity == 0 ? 1 : capacity)
+    {
+    }
+
+    // Returns the live value and marks it most recently used.
+    const Value *Find(const Key &key, const TimePoint now)
+    {
+        return Find(key, now, [](const Key &, const Value &) {});
+    }
+
+    // Same as above; an expired entry is passed to on_expired(key, value) before it is dropped.
+    template <typename OnExpired> const Value *Find(const Key &key, const TimePoint now, OnExpired &&on_expired)
+    {
+        const auto it = index_.find(key);
+        if (it == index_.end())
+        {
+            return nullptr;
+        }
+        if (it->second->expires_at <= now)
+        {
+            on_expired(it->second->key, it->second->value);
+            entries_.erase(it->second);
+            index_.erase(it);
+            return nullptr;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return &it->second->value;
+    }
+
+    // Inserts or replaces the value. Returns the entry evicted to make room, if any.
+    std::optional<std::pair<Key, Value>> Insert(const Key &key, Value value, const TimePoint expires_at)
+    {
+        if (const auto it = index_.find(key); it != index_.end())
+        {
+            it->second->value = std::move(value);
+            it->second->expires_at = expires_at;
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return std::nullopt;
+        }
+        std::optional<std::pair<Key, Value>> evicted;
+        if (entries_.size() >= capacity_)
+        {
+            auto &coldest = entries_.back();
+            index_.erase(coldest.key);
+            evicted.emplace(std::move(coldest.key), std::move(coldest.value));
+            entries_.pop_back();
+        }
+        entries_.push_front({key, std::move(value), expires_at});
+        index_.emplace(key, entries_.begin());
+        return evicted;
+    }
+
+    bool Erase(const Key &key)
+    {
+        const auto it = index_.find(key);
+        if (it == index_.end())
+        {
+            return false;
+        }
+        entries_.erase(it->second);
+        index_.erase(it);
+        return true;
+    }
+
+    std::size_t Size() const
+    {
+        return entries_.size();
+    }
+
+  private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        TimePoint expires_at;
+    };
+
+    std::size_t capacity_;
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<Key, typename std::list<Entry>::iterator> index_;
+};
+} // namespace server::utilities
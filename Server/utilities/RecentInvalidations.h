@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+
+namespace server::utilities
+{
+/*
+ * Keys invalidated within the last window, so that a cache can refuse a value read from its backing store while the
+ * same key changed: only fills racing with an invalidation of their own key are refused, not every fill in flight.
+ * Entries are pruned as new ones are recorded, so the set is bounded by the invalidation rate times the window.
+ * Not thread-safe: callers keep it under the lock of the cache shard it guards.
+ */
+template <typename Key, typename Clock = std::chrono::steady_clock> class RecentInvalidations
+{
+  public:
+    using TimePoint = typename Clock::time_point;
+
+    explicit RecentInvalidations(const typename Clock::duration window) : window_(window)
+    {
+    }
+
+    void Record(const Key &key, const TimePoint now)
+    {
+        while (!order_.empty() && now - order_.front().first >= window_)
+        {
+            // A later invalidation of the same key keeps its entry.
+            if (const auto it = invalidated_at_.find(order_.front().second);
+                it != invalidated_at_.end() && it->second == order_.front().first)
+            {
+                invalidated_at_.erase(it);
+            }
+            order_.pop_front();
+        }
+        // Invalidations may be recorded slightly out of order; the latest one wins.
+        auto [it, inserted] = invalidated_at_.try_emplace(key, now);
+        if (!inserted && it->second < now)
+        {
+            it->second = now;
+        }
+        order_.emplace_back(now, key);
+    }
+
+    // Whether a value of key read since read_start may be cached: false if the key was invalidated at or after
+    // read_start, or if read_start is too old for the invalidations that followed it to still be known.
+    bool MayCache(const Key &key, const TimePoint read_start, const TimePoint now) const
+    {
+        if (now - read_start >= window_)
+        {
+            return false;
+        }
+        const auto it = invalidated_at_.find(key);
+        return it == invalidated_at_.end() || it->second < read_start;
+    }
+
+  private:
+    typename Clock::duration window_;
+    std::unordered_map<Key, TimePoint> invalidated_at_;
+    std::deque<std::pair<TimePoint, Key>> order_;
+};
+} // namespace server::utilities
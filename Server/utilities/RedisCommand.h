@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <concepts>
+#include <initializer_list>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace server::utilities
+{
+// One argument of a RedisCommand: a view of a string, or an integer rendered into an inline buffer.
+class RedisArgument
+{
+  public:
+    RedisArgument(const std::string_view value) : value_(value)
+    {
+    }
+    RedisArgument(const std::string &value) : value_(value)
+    {
+    }
+    RedisArgument(const char *value) : value_(value)
+    {
+    }
+    template <std::integral Integer> RedisArgument(const Integer value)
+    {
+        const auto result = std::to_chars(buffer_.data(), buffer_.data() + buffer_.size(), value);
+        value_ = std::string_view(buffer_.data(), result.ptr);
+    }
+    // May view its own buffer.
+    RedisArgument(const RedisArgument &) = delete;
+    RedisArgument &operator=(const RedisArgument &) = delete;
+
+    const char *Data() const
+    {
+        return value_.data();
+    }
+    std::size_t Size() const
+    {
+        return value_.size();
+    }
+
+  private:
+    std::array<char, 24> buffer_;
+    std::string_view value_;
+};
+
+/*
+ * Binary-safe Redis command with a fixed number of arguments, command name included.
+ * Each argument reaches hiredis as its own "%b" bulk string: payloads are written once into the protocol buffer,
+ * never formatted into a command line or split on spaces, and may contain any byte.
+ * Only views are kept, so the command must not outlive its arguments; build it right before the call:
+ *     const RedisCommand command("SET", key, value, "EXAT", expiry);
+ *     co_await command.Apply([&](const auto... argv) { return redis_client->execCommandCoro(argv...); });
+ */
+template <std::size_t N> class RedisCommand
+{
+  public:
+    template <typename... Args>
+        requires(sizeof...(Args) == N)
+    explicit RedisCommand(const Args &...args) : arguments_{RedisArgument(args)...}
+    {
+    }
+
+    // Calls fn(format, data_0, size_0, ..., data_N-1, size_N-1), the calling convention of hiredis and drogon's
+    // execCommand* functions.
+    template <typename Fn> decltype(auto) Apply(Fn &&fn) const
+    {
+        return [&]<std::size_t... I>(std::index_sequence<I...>) -> decltype(auto) {
+            return std::forward<Fn>(fn)(Format(), Part<I>()...);
+        }(std::make_index_sequence<2 * N>{});
+    }
+
+  private:
+    static const char *Format()
+    {
+        static const std::string format = [] {
+            std::string result;
+            for (std::size_t i = 0; i < N; ++i)
+            {
+                result += i == 0 ? "%b" : " %b";
+            }
+            return result;
+        }();
+        return format.c_str();
+    }
+
+    template <std::size_t I> auto Part() const
+    {
+        if constexpr (I % 2 == 0)
+        {
+            return arguments_[I / 2].Data();
+        }
+        else
+        {
+            return arguments_[I / 2].Size();
+        }
+    }
+
+    std::array<RedisArgument, N> arguments_;
+};
+
+template <typename... Args> RedisCommand(const Args &...) -> RedisCommand<sizeof...(Args)>;
+
+/*
+ * hiredis format string passing leading followed by every element of arguments, for commands such as MGET whose
+ * argument count is only known at runtime: drogon's execCommand* take a format and C varargs, which RedisCommand's
+ * fixed arity cannot fill. '%' is escaped, so no argument is read as a format directive. hiredis splits the format on
+ * spaces, which cannot be escaped, so std::nullopt is returned if an argument is empty or holds a space. Meant for
+ * keys and ids; payloads go through RedisCommand.
+ *     const auto format = RedisArgumentFormat({"MGET"}, keys);
+ *     if (format) redis_client->execCommandAsync(on_result, on_error, *format);
+ */
+template <std::ranges::input_range Arguments>
+std::optional<std::string> RedisArgumentFormat(const std::initializer_list<RedisArgument> leading,
+                                               const Arguments &arguments)
+{
+    std::string format;
+    const auto append = [&format](const RedisArgument &argument) {
+        const std::string_view value(argument.Data(), argument.Size());
+        if (value.empty() || value.contains(' '))
+        {
+            return false;
+        }
+        if (!format.empty())
+        {
+            format += ' ';
+        }
+        for (const char c : value)
+        {
+            format += c;
+            if (c == '%')
+            {
+                format += '%';
+            }
+        }
+        return true;
+    };
+    for (const auto &argument : leading)
+    {
+        if (!append(argument))
+        {
+            return std::nullopt;
+        }
+    }
+    for (const auto &argument : arguments)
+    {
+        if (!append(RedisArgument(argument)))
+        {
+            return std::nullopt;
+        }
+    }
+    return format;
+}
+} // namespace server::utilities
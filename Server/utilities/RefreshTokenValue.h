@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace server::utilities
+{
+// What the last login or rotation left at a refresh token's key.
+struct RefreshTokenState
+{
+    // Empty if no access token was issued for it.
+    std::string access_token_id;
+    std::chrono::system_clock::time_point access_expires_at;
+    // Expiry of the access token the last rotation superseded, if any.
+    std::optional<std::chrono::system_clock::time_point> superseded_expires_at;
+};
+
+// Value stored at refresh_token:<user>:<id>: the id of its only valid access token, which HasAccessToken matches as a
+// prefix, and that token's expiry in whole seconds, like the token's own exp claim.
+inline std::string AccessTokenValue(const std::string_view access_token_id,
+                                    const std::chrono::system_clock::time_point expires_at)
+{
+    return std::format("{};exp:{:%Y-%m-%d_%H:%M:%S}", access_token_id,
+                       std::chrono::time_point_cast<std::chrono::seconds>(expires_at));
+}
+
+// Reads a "%Y-%m-%d_%H:%M:%S" expiry written by AccessTokenValue. Values written before expiries were truncated to
+// seconds carry a fractional part, which is ignored.
+inline std::optional<std::chrono::system_clock::time_point> ParseExpiry(std::string_view text)
+{
+    // Offset and length of the year, month, day, hours, minutes and seconds.
+    static constexpr std::array<std::pair<std::size_t, std::size_t>, 6> kFields{
+        {{0, 4}, {5, 2}, {8, 2}, {11, 2}, {14, 2}, {17, 2}}};
+    constexpr std::size_t kSize{19};
+    if (text.size() > kSize && text[kSize] == '.')
+    {
+        const auto fraction = text.substr(kSize + 1);
+        if (fraction.empty() || fraction.find_first_not_of("0123456789") != std::string_view::npos)
+        {
+            return std::nullopt;
+        }
+        text = text.substr(0, kSize);
+    }
+    if (text.size() != kSize)
+    {
+        return std::nullopt;
+    }
+    std::array<int, kFields.size()> values{};
+    for (std::size_t i = 0; i < kFields.size(); ++i)
+    {
+        const auto *const begin = text.data() + kFields[i].first;
+        const auto *const end = begin + kFields[i].second;
+        if (const auto [ptr, ec] = std::from_chars(begin, end, values[i]); ec != std::errc{} || ptr != end)
+        {
+            return std::nullopt;
+        }
+    }
+    const std::chrono::year_month_day date{std::chrono::year{values[0]},
+                                           std::chrono::month{static_cast<unsigned>(values[1])},
+                                           std::chrono::day{static_cast<unsigned>(values[2])}};
+    if (!date.ok())
+    {
+        return std::nullopt;
+    }
+    return std::chrono::sys_days{date} + std::chrono::hours{values[3]} + std::chrono::minutes{values[4]} +
+           std::chrono::seconds{values[5]};
+}
+
+// Inverse of AccessTokenValue, plus the ";prev:" suffix of rotations. "1" is a refresh token without access token.
+inline std::optional<RefreshTokenState> ParseAccessTokenValue(std::string_view value)
+{
+    RefreshTokenState state;
+    if (value == "1")
+    {
+        return state;
+    }
+    constexpr std::string_view kExpiry{";exp:"};
+    constexpr std::string_view kPrevious{";prev:"};
+    const auto expiry = value.find(kExpiry);
+    if (expiry == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    state.access_token_id = value.substr(0, expiry);
+    value.remove_prefix(expiry + kExpiry.size());
+    if (const auto previous = value.find(kPrevious); previous != std::string_view::npos)
+    {
+        state.superseded_expires_at = ParseExpiry(value.substr(previous + kPrevious.size()));
+        if (!state.superseded_expires_at)
+        {
+            return std::nullopt;
+        }
+        value = value.substr(0, previous);
+    }
+    const auto access_expires_at = ParseExpiry(value);
+    if (!access_expires_at)
+    {
+        return std::nullopt;
+    }
+    state.access_expires_at = *access_expires_at;
+    return state;
+}
+} // namespace server::utilities
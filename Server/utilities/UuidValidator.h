@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace server::utilities
+{
+namespace detail
+{
+// Class of every byte allowed somewhere in a UUID.
+enum UuidCharClass : uint8_t
+{
+    kNotHex = 0,
+    // 0-5
+    kLowDigit = 1 << 0,
+    // 6-9, a-f and A-F
+    kHex = 1 << 1,
+    // 0, 8, 9, a, b, A and B
+    kVariant = 1 << 2,
+};
+
+constexpr std::array<uint8_t, 256> kUuidCharClasses = [] {
+    std::array<uint8_t, 256> classes{};
+    for (char c = '0'; c <= '9'; ++c)
+    {
+        classes[static_cast<uint8_t>(c)] |= c <= '5' ? kLowDigit : kHex;
+    }
+    for (char c = 'a'; c <= 'f'; ++c)
+    {
+        classes[static_cast<uint8_t>(c)] |= kHex;
+        classes[static_cast<uint8_t>(c - 'a' + 'A')] |= kHex;
+    }
+    for (const char c : {'0', '8', '9', 'a', 'b', 'A', 'B'})
+    {
+        classes[static_cast<uint8_t>(c)] |= kVariant;
+    }
+    return classes;
+}();
+
+// Classes required at each position; 0 marks the dashes.
+constexpr std::array<uint8_t, 36> kUuidLayout = [] {
+    std::array<uint8_t, 36> layout{};
+    layout.fill(kLowDigit | kHex);
+    for (const std::size_t dash : {8, 13, 18, 23})
+    {
+        layout[dash] = 0;
+    }
+    // Version nibble.
+    layout[14] = kLowDigit;
+    // Variant nibble.
+    layout[19] = kVariant;
+    return layout;
+}();
+} // namespace detail
+
+/*
+ * Accepts exactly what ^[0-9a-f]{8}-[0-9a-f]{4}-[0-5][0-9a-f]{3}-[089ab][0-9a-f]{3}-[0-9a-f]{12}$ matches
+ * case-insensitively: one table lookup per byte, no allocation. Every position is checked without an early exit, so
+ * the loop has no data-dependent branches and the compiler may vectorize it.
+ */
+constexpr bool IsUuid(const std::string_view value)
+{
+    if (value.size() != detail::kUuidLayout.size())
+    {
+        return false;
+    }
+    bool valid = true;
+    for (std::size_t i = 0; i < detail::kUuidLayout.size(); ++i)
+    {
+        const auto required = detail::kUuidLayout[i];
+        const auto c = static_cast<uint8_t>(value[i]);
+        valid &= required == 0 ? c == '-' : (detail::kUuidCharClasses[c] & required) != 0;
+    }
+    return valid;
+}
+} // namespace server::utilities